@@ -3,18 +3,42 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#if defined(__SSE2__) && !defined(SCALAR_SEARCH)
+#include <immintrin.h> // set search (see match_set)
+#endif
 
 #define __STDC_FORMAT_MACROS // for printing uint64_t
 #include <inttypes.h>
 
 #include "cache.h"
 #include "utils.h"
+#include "mrc.h"
+#ifdef FIXED_GEOMETRY
+#include "geometry.h" // sgxc-fixed ; see gen_geometry.py
+#endif
 
-void edit_line(int action, sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, cacheline_t* set, int set_idx, int way_idx);
+void edit_line(int action, sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int way_idx);
 int get_enclave_set(sim_t* sim, process_t* p, cache_t* c, int cache_type, uint64_t addr, uint64_t* tag);
-int search_set(sim_t* sim, process_t* p, cache_config_t* config, cacheline_t* set, int set_idx, int* free, int eid, uint64_t tag);
+int search_set(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag);
 int find_free_offset(sim_t* sim, process_t* p, cache_config_t* config);
 int get_dyn_enclave_set_and_tag(process_t* p, cache_t* c, int cache_type, uint64_t addr, uint64_t* tag);
+static void init_plru_paths();
+static void bind_access_path(sim_t* sim, cache_config_t* c);
+static void init_levels(sim_t* sim, core_t* core);
+static void init_addressing(cache_config_t* c);
+static void init_directory(sim_t* sim);
+
+#define MATCH_WAYS 8 // ways compared per step of match_set()
+
+// zeroed memory starting on a host cache line
+static void* alloc_aligned(size_t size) {
+    size = (size + HOST_LINE_SIZE - 1) / HOST_LINE_SIZE * HOST_LINE_SIZE; // aligned_alloc() takes multiples of the alignment
+    if(size == 0) size = HOST_LINE_SIZE;
+    void* m = aligned_alloc(HOST_LINE_SIZE, size);
+    if(!m) error("Failed to allocate cache memory");
+    memset(m, 0, size);
+    return m;
+}
 
 cache_t* alloc_cache(cache_t* cache, cache_config_t* config) {
 	
@@ -22,30 +46,19 @@ cache_t* alloc_cache(cache_t* cache, cache_config_t* config) {
 	if(!cache) {
 		c = malloc(sizeof(cache_t));
 		memset(c, 0, sizeof(cache_t));
-        for(int i=0; i<3; i++) {
-			c->config[i] = NULL;
-			c->cache[i] = NULL;
-			c->plru[i] = NULL;
-		}
+        for(int i=0; i<3; i++) c->config[i] = NULL;
 		c->unified = (config->type == UNIFIED_CACHE);
 	}
 	else c = cache;
 	
-	/* allocate cache memory */
-	c->cache[config->type] = malloc(config->sets_n * sizeof(cacheline_t*));
-	c->plru[config->type] = malloc(config->sets_n * sizeof(char*));
-
-	for(int s=0; s<config->sets_n; s++) {
-		c->cache[config->type][s] = (cacheline_t*) malloc(config->ways_n * sizeof(cacheline_t));
-		c->plru[config->type][s] = malloc( (config->ways_n-1) * sizeof(char));
-		memset(c->plru[config->type][s], 0, (config->ways_n-1) * sizeof(char));
-		for(int w=0; w<config->ways_n; w++) {
-			c->cache[config->type][s][w].valid = 0;
-			c->cache[config->type][s][w].eid = -1;
-		    c->cache[config->type][s][w].dirty = 0;
-            c->cache[config->type][s][w].enclave_mode = 0;
-        }
-	}
+	/* allocate cache memory ; all lines start invalid */
+	cache_lines_t* lines = &c->lines[config->type];
+	size_t lines_n = (size_t) config->sets_n * config->ways_n;
+	lines->ways_n = config->ways_n;
+	lines->tags = alloc_aligned((lines_n + MATCH_WAYS) * sizeof(uint64_t)); // the tags of a set fill one or two of the host's cache lines
+	lines->meta = alloc_aligned((lines_n + MATCH_WAYS) * sizeof(uint16_t)); // match_set() reads whole steps past the last set
+	lines->plru_levels = log2(config->ways_n);
+	lines->plru = alloc_aligned((size_t) config->sets_n * sizeof(uint64_t));
 	c->config[config->type] = config;
 	c->next = NULL;
 
@@ -57,6 +70,20 @@ cache_t* alloc_cache(cache_t* cache, cache_config_t* config) {
 
 void init_cache(sim_t* sim) {
 
+    if(sim->prog_n > LINE_EIDS_N) {
+        printf("At most %i programs can be simulated (line metadata holds the eid)\n", LINE_EIDS_N);
+        exit(1);
+    }
+
+#ifdef FIXED_GEOMETRY
+    if(sim->config_n != FIXED_CONFIGS_N) {
+        printf("This sgxc was built for the %i caches of %s ; use the generic sgxc\n", FIXED_CONFIGS_N, FIXED_CONFIG_FILE);
+        exit(1);
+    }
+    printf("Cache geometry built in from %s\n", FIXED_CONFIG_FILE);
+#endif
+
+	init_plru_paths();
 	int max_partition = 0;
 	// precompute additional config values for each cache	
 	for(int i=0; i<sim->config_n; i++) {		
@@ -80,6 +107,10 @@ void init_cache(sim_t* sim) {
 			}
 		}
 	
+        if(c->ways_n > (1 << PLRU_LEVELS_MAX)) {
+            printf("%s: at most %i ways are supported\n", c->name, 1 << PLRU_LEVELS_MAX);
+            exit(1);
+        }
 		c->addr_bits_n = ADDR_BITS;
 		c->offset_bits_n = log2(c->line_size);
 		c->sets_n = (c->size_kb * 1024)/(c->ways_n * c->line_size);
@@ -103,6 +134,8 @@ void init_cache(sim_t* sim) {
             memset(c->way_bitmaps, 0, sizeof(uint64_t) * c->max_partition); // all ways are initially for non-enclaves
             
         }
+        init_addressing(c);
+        bind_access_path(sim, c);
 		
 	}	
 	
@@ -178,6 +211,7 @@ void init_cache(sim_t* sim) {
 
 	// private caches
 	sim->cores = malloc(sizeof(core_t) * sim->cores_n);
+	memset(sim->cores, 0, sizeof(core_t) * sim->cores_n); // alloc_and_reset_counts() needs NULL counts
 	sim->progs_per_core = ceil(sim->prog_n/sim->cores_n);
 	for(int i=0; i<sim->cores_n; i++) {
 		core_t* core = &sim->cores[i];
@@ -185,7 +219,8 @@ void init_cache(sim_t* sim) {
 		core->process_n = 0;
 		core->clock = 0;
 		core->offset_table = sim->offset_table;
-		//alloc_and_reset_counts(&core->nstat_counts);
+		core->ring = NULL;
+		alloc_and_reset_counts(&core->nstat_counts);
 
         core->processes = malloc(sim->progs_per_core * sizeof(process_t));
 		memset(core->processes, 0, sim->progs_per_core * sizeof(process_t));
@@ -232,7 +267,9 @@ void init_cache(sim_t* sim) {
 			ptr = ptr->next;
 		}
 		if(prev) prev->next = sim->cache;
+		init_levels(sim, core);
 	}
+	init_directory(sim);
 
 	return;
 }
@@ -246,6 +283,27 @@ int get_cache_type(cache_t* c, int op) {
 	return -1;
 }
 
+// the caches of a core as an array ; accesses index it instead of following cache_t.next
+static void init_levels(sim_t* sim, core_t* core) {
+    core->levels_n = 0;
+    core->private_n = 0;
+    for(cache_t* c = core->cache; c; c = c->next) {
+        if(c == sim->cache) core->private_n = core->levels_n;
+        core->levels_n++;
+    }
+    if(!sim->cache) core->private_n = core->levels_n;
+
+    core->levels = malloc(core->levels_n * sizeof(level_t));
+    int i = 0;
+    for(cache_t* c = core->cache; c; c = c->next, i++) {
+        level_t* l = &core->levels[i];
+        l->cache = c;
+        for(int op=LOAD_OP; op<=INSN_OP; op++) l->type[op] = get_cache_type(c, op);
+        l->llc = (c->next == NULL);
+        l->fast = (i == 0 && i < core->private_n && !l->llc);
+    }
+}
+
 // reconstructs the address given the tag and set index
 uint64_t get_addr(uint64_t tag, int idx, int offset_bits_n) {
     
@@ -268,13 +326,83 @@ void set_way_bitmap(uint64_t* bitmap, int way) {
     *bitmap = (*bitmap) | (1 << way);
 }
 
+// mask of the n low bits
+static inline uint64_t low_mask(int n) {
+    return (n >= 64) ? ~0ull : (1ull << n) - 1;
+}
+
+void set_eway_bits(cache_config_t* config, enclave_way_info_t* eway, int set_bits_n) {
+    eway->set_bits_n = set_bits_n;
+    eway->set_mask = low_mask(set_bits_n) << config->offset_bits_n;
+    eway->tag_mask = low_mask(config->addr_bits_n - (set_bits_n + config->offset_bits_n)) << (config->offset_bits_n + set_bits_n);
+}
+
+// directory: every line of an inclusive shared cache keeps the private caches of its core that may hold a copy,
+// so evicting it only searches those (see edit_line) ; copies are one line at the same address in every cache, so this
+// needs a single shared level, private caches without partitions, one line size and no quantum mode (private phases
+// skip the shared caches). Otherwise every level is searched
+// The shared cache must also keep every line visible to lookups of its mode: sgx_plru picks victims across the way
+// partition, and enclave ways or cachelets allocated during the run hide the lines already in them. A hidden line is
+// placed again in another way, private copies then get their sharers on either line, and evicting the other one
+// would skip them
+static void init_directory(sim_t* sim) {
+
+    if(!sim->uses_inclusive || !sim->cache || sim->cache->next) return;
+    if(sim->quantum_n > 0 || sim->quantum_clock > 0) return;
+    int bits_n = 0;
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        if(c->line_size != sim->config[0].line_size) return;
+        if(c->shared && c->inclu_policy != INCLUSIVE) return;
+        if(c->shared && c->partition && (c->evict_policy == EVICT_SGX_PLRU || c->set_partition)) return;
+        if(c->shared && c->use_cachelet) return;
+        if(!c->shared && (c->inclu_policy == INCLUSIVE || c->partition || c->set_partition || c->use_cachelet)) return;
+        if(!c->shared) bits_n++;
+    }
+    if(bits_n > DIR_SHARERS_MAX) return;
+
+    bits_n = 0;
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        if(!c->shared) {
+            c->dir_bit = 1 << bits_n++;
+            continue;
+        }
+        // set_partition indexes enclave lines by partition ; their address cannot be rebuilt from the set
+        c->dir_tracked[NON_ENCLAVE] = 1;
+        c->dir_tracked[ENCLAVE] = !c->set_partition;
+        cache_lines_t* lines = &sim->cache->lines[c->type];
+        lines->sharers = alloc_aligned((size_t) c->sets_n * c->ways_n * sizeof(uint16_t));
+    }
+}
+
+// masks and shifts of the partitions of a cache ; enclave accesses only look them up
+static void init_addressing(cache_config_t* c) {
+
+    c->partition_bits_n = (c->max_partition > 0) ? log2(c->max_partition) : 0;
+    if(c->max_partition > 0) {
+        c->way_bitmap_shift = c->set_bits_n - c->partition_bits_n;
+        c->way_bitmap_mask = ((uint64_t) c->max_partition - 1) << c->way_bitmap_shift;
+    }
+    if(c->eway_info) {
+        for(int w=0; w<c->max_enclave_ways_n; w++) set_eway_bits(c, &c->eway_info[w], c->eway_info[w].set_bits_n);
+    }
+
+    if(c->use_cachelet && c->max_partition > 0) { // a process has 1, 2, 4 .. max_partition cachelets
+        c->cachelet_set_masks = malloc((c->partition_bits_n + 1) * sizeof(uint64_t));
+        c->cachelet_tag_masks = malloc((c->partition_bits_n + 1) * sizeof(uint64_t));
+        for(int i=0; i<=c->partition_bits_n; i++) {
+            int set_bits_n = log2((c->sets_n/c->max_partition) * (1 << i));
+            c->cachelet_set_masks[i] = low_mask(set_bits_n) << c->offset_bits_n;
+            c->cachelet_tag_masks[i] = low_mask(c->addr_bits_n - (set_bits_n + c->offset_bits_n)) << (c->offset_bits_n + set_bits_n);
+        }
+    }
+}
+
 // read the upper bits of the set index
 int get_way_bitmap_idx(cache_config_t* config, int set_idx) {
     if(config->max_partition == 0) return -1;
-    uint64_t mask = (uint64_t) config->max_partition - 1;
-    int pbits_n = log2(config->max_partition);
-    mask = mask << (config->set_bits_n - pbits_n);
-    return (set_idx & mask) >> (config->set_bits_n - pbits_n);
+    return (set_idx & config->way_bitmap_mask) >> config->way_bitmap_shift;
 }
 
 uint64_t* get_bitmap(process_t* p, cache_config_t* config) {
@@ -283,10 +411,35 @@ uint64_t* get_bitmap(process_t* p, cache_config_t* config) {
     return &config->way_bitmaps[get_way_bitmap_idx(config, offset)];
 }
 
-// slot = either a way or a set (enclave way)
-void update_plru(char* plru, int slots_n, int slot_accessed) { 
+// PLRU tree of a set ; bit n is node n (children 2n+1 and 2n+2) and points to the left (0) or right (1) sub-tree
+// plru_paths[levels][way]: the nodes on the path to way, and their bits once the way is accessed (pointing away from it)
+static plru_path_t plru_paths[PLRU_LEVELS_MAX + 1][1 << PLRU_LEVELS_MAX];
+
+static void init_plru_paths() {
+    for(int levels=0; levels<=PLRU_LEVELS_MAX; levels++) {
+        for(int w=0; w<(1 << levels); w++) {
+            plru_path_t* path = &plru_paths[levels][w];
+            int node = 0;
+            for(int i=levels-1; i>=0; i--) {
+                int dir = (w >> i) & 1;
+                path->mask |= 1ull << node;
+                if(!dir) path->bits |= 1ull << node; // set bit to opposite of taken path
+                node = 2*node + 1 + dir;
+            }
+        }
+    }
+}
+
+void touch_plru(cache_lines_t* lines, int set_idx, int way) {
+    plru_path_t* path = &plru_paths[lines->plru_levels][way];
+    uint64_t* plru = get_plru(lines, set_idx);
+    *plru = (*plru & ~path->mask) | path->bits;
+}
+
+// slot = a set of an enclave way (Set Allocation Table) ; cache ways use touch_plru()
+void update_plru(char* plru, int levels, int slot_accessed) { 
     
-    int t = log2(slots_n) - 1; // number of traversals
+    int t = levels - 1; // number of traversals
     
     int p_idx  = 0;
     for(int i=t; i>=0; i--) {
@@ -301,49 +454,51 @@ void update_plru(char* plru, int slots_n, int slot_accessed) {
     }
 }
 
-void set_line(process_t* p, cacheline_t* cl, uint64_t tag) {
+void set_line(process_t* p, cache_lines_t* lines, int set_idx, int way, uint64_t tag) {
 
-    assert(cl->valid == 0);
+    size_t i = line_idx(lines, set_idx, way);
+    assert(!line_valid(lines->meta[i]));
 
     access_t* a = p->access;
-    cl->valid = 1;
-    cl->tag = tag;
     assert(a->eid == p->eid);
-    cl->eid = p->eid;
-    cl->dirty = (a->op == STORE_OP);
-    cl->enclave_mode = a->enclave_mode;
+    lines->tags[i] = tag;
+    lines->meta[i] = line_meta(p->eid, a->enclave_mode, a->op == STORE_OP);
 }
 
 uint64_t get_tag(process_t* p, cache_config_t* config, uint64_t addr) {
      
     if(p->access->enclave_mode && config->set_partition) {
         enclave_way_info_t* eway = &config->eway_info[p->eway_idx]; // obtain the assigned enclave way
-	    
-        int tag_bits_n = (config->addr_bits_n - (eway->set_bits_n + config->offset_bits_n) );
-	    uint64_t tag_mask = (uint64_t) pow(2, tag_bits_n) - 1;
-	    tag_mask = tag_mask << (config->offset_bits_n + eway->set_bits_n);
-	    return addr & tag_mask;
+	    return addr & eway->tag_mask;
     } else return addr & config->tag_mask;
 }
 
 
-int get_set_and_tag(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, int enclave_mode, uint64_t* tag) {
-    
-    int set_idx;
-    if(config->use_cachelet && sim->dyn_threshold > 0 && enclave_mode) set_idx = get_dyn_enclave_set_and_tag(p, c, cache_type, addr, tag);
-    else if(enclave_mode && config->set_partition) set_idx = get_enclave_set(sim, p, c, cache_type, addr, tag);
-    else set_idx = (addr & config->set_mask) >> config->offset_bits_n;
-    
-    if(sim->dyn_threshold == 0) *tag = get_tag(p, config, addr);
+/* set index and tag of an address ; config->index[] */
 
-    return set_idx;
+static int index_plain(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, uint64_t* tag) {
+    (void) sim; (void) p; (void) c; (void) cache_type;
+    *tag = addr & config->tag_mask; // not get_tag() ; an inclusion walk indexes lines of the other mode than the access
+    return (addr & config->set_mask) >> config->offset_bits_n;
+}
+
+static int index_enclave_set(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, uint64_t* tag) {
+    (void) config;
+    return get_enclave_set(sim, p, c, cache_type, addr, tag);
+}
+
+static int index_dyn_cachelet(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, uint64_t* tag) {
+    (void) sim; (void) config;
+    return get_dyn_enclave_set_and_tag(p, c, cache_type, addr, tag);
 }
 
 // start_id ; id of the cache where this line was initially chosen to be evicted
-char search_and_edit(int action, sim_t* sim, process_t* p, cache_t* c, char* evicted, int start_id, char start_is_inclu, int cache_type, int eid, uint64_t addr, int enclave_mode) { 
+// sharers (directory, see init_directory) ; EVICT_LINE: private caches that may hold the line ; SET_LINE: gets the private caches that were given a copy
+char search_and_edit(int action, sim_t* sim, process_t* p, cache_t* c, char* evicted, int start_id, char start_is_inclu, int cache_type, int eid, uint64_t addr, int enclave_mode, uint16_t* sharers) { 
     
     cache_config_t* config = c->config[cache_type];
     if(config->id == start_id) return 0; // want to evict/set where we started from afterwards
+    if(action == EVICT_LINE && config->dir_bit && !(config->dir_bit & *sharers)) return 0; // no copy here
     if(action == SET_LINE) {
         if(start_is_inclu && config->level != 1) return 0; // we only need to place it in the first level cache
         else if (!start_is_inclu && config->inclu_policy != INCLUSIVE) return 0; // if we start from private level cache, we only need to set line in inclusive cache
@@ -353,60 +508,53 @@ char search_and_edit(int action, sim_t* sim, process_t* p, cache_t* c, char* evi
 
     // must recalculate tag and set for each level of cache
     uint64_t tag;
-    int set_idx = get_set_and_tag(sim, p, c, cache_type, config, addr, enclave_mode, &tag);
+    int set_idx = config->index[enclave_mode](sim, p, c, cache_type, config, addr, &tag);
     
-    cacheline_t* set = c->cache[cache_type][set_idx];
+    cache_lines_t* lines = &c->lines[cache_type];
     int free = -1;
     int w = -1; // indicates hit or miss
     if(action == EVICT_LINE) {
         if(!start_is_inclu && config->id != start_id && config->inclu_policy == NON_INCLUSIVE) return 1; // no need to evict elsewhere ; there is a copy in this cache
         
-        w = search_set(sim, p, config, set, set_idx, &free, eid, tag);
+        w = config->lookup[enclave_mode](sim, p, config, lines, set_idx, &free, eid, enclave_mode, tag);
         if(w != -1) { // cache hit
-            cacheline_t* cl = &set[w];
-            if(cl->valid && cl->dirty) update_stat(sim, p->nstat_counts, STAT_DIRTY_LINES, cl->enclave_mode);
-
-            if(sim->uses_inclusive) {
-                *evicted = 1;
-                // find the process whose line was evicted due to inclusion
-                int core_id = sim->eid_to_core_id[cl->eid];
-                core_t* core = &sim->cores[core_id]; // the core where this cache line originated
-                process_t* victim = NULL;
-                for(int i=0; i<core->process_n; i++) {
-                    if(core->processes[i].eid == cl->eid) {
-                        victim = &core->processes[i];
-                        break;
-                    }
-                }
+            uint16_t* meta = &lines->meta[line_idx(lines, set_idx, w)];
+            int line_enclave = line_enclave_mode(*meta);
+            if(line_valid(*meta) && line_dirty(*meta)) update_stat(sim, p->nstat_counts, STAT_DIRTY_LINES, line_enclave);
+
+            if(sim->uses_inclusive) *evicted = 1;
+            if(sim->uses_inclusive && sim->trace_n >= sim->start_stat) { // only counts ; skipped during warmup
+                process_t* victim = sim->eid_to_process[line_eid(*meta)]; // the process whose line was evicted due to inclusion
                 assert(victim != NULL);
-                update_stat(sim, victim->nstat_counts, STAT_IS_INCLUSION_VICTIM, cl->enclave_mode); // vicitm's line was removed
-                update_stat(sim, p->nstat_counts, STAT_EVICT_INCLUSION_VICTIM, cl->enclave_mode); // this process evicted the line
+                update_stat(sim, victim->nstat_counts, STAT_IS_INCLUSION_VICTIM, line_enclave); // vicitm's line was removed
+                update_stat(sim, p->nstat_counts, STAT_EVICT_INCLUSION_VICTIM, line_enclave); // this process evicted the line
 
                 if(victim->eid != p->eid) {
-                    update_stat(sim, victim->nstat_counts, STAT_IS_INCLUSION_VICTIM_OTHER, cl->enclave_mode); // vicitm's line was removed by another process that is not the victim
-                    update_stat(sim, p->nstat_counts, STAT_EVICT_INCLUSION_VICTIM_OTHER, cl->enclave_mode); // this process evicted the line that is not their line
+                    update_stat(sim, victim->nstat_counts, STAT_IS_INCLUSION_VICTIM_OTHER, line_enclave); // vicitm's line was removed by another process that is not the victim
+                    update_stat(sim, p->nstat_counts, STAT_EVICT_INCLUSION_VICTIM_OTHER, line_enclave); // this process evicted the line that is not their line
                 }
             }
 
-            cl->valid = 0;
+            *meta &= ~LINE_VALID;
         }
         if(config->inclu_policy == INCLUSIVE) return 1;
 
     } else if(action == SET_LINE) {
-        w = search_set(sim, p, config, set, set_idx, &free, eid, tag);
-        if(w != -1) return 1; // cache hit ; this is possible, example, line hits in L2 (and is already in L3) and missed in L1 ; tried to place in L3 and its already there (hits)
+        w = config->lookup[enclave_mode](sim, p, config, lines, set_idx, &free, eid, enclave_mode, tag);
+        *sharers |= config->dir_bit;
+        if(w != -1) { // cache hit ; this is possible, example, line hits in L2 (and is already in L3) and missed in L1 ; tried to place in L3 and its already there (hits)
+            if(lines->sharers) lines->sharers[line_idx(lines, set_idx, w)] |= sim->config[start_id].dir_bit; // the starting private cache gets a copy
+            return 1;
+        }
         if(free == -1) { // there are no free cache ways ; must evict 
-            int evict_idx;
-            if( (enclave_mode && config->set_partition && !config->use_cachelet) || 
-                (enclave_mode && config->use_cachelet && sim->cachelet_assoc <= 1) ) evict_idx = p->eway_idx; // direct-mapped cache
-            else evict_idx = pick_victim_way(sim, p, c, config, cache_type, set_idx, enclave_mode); // performs plru
-            edit_line(EVICT_LINE, sim, p, c, config, set, set_idx, evict_idx);	 
+            int evict_idx = config->victim[enclave_mode](sim, p, c, config, cache_type, set_idx, enclave_mode); // direct-mapped or plru
+            edit_line(EVICT_LINE, sim, p, config, lines, set_idx, evict_idx);	 
             free = evict_idx;
         }
         assert(free != -1); // at this point there must be a free spot
-        cacheline_t* cl = &set[free];
-        set_line(p, cl, tag);
-        if(config->evict_policy == EVICT_PLRU || config->evict_policy == EVICT_SGX_PLRU) update_plru(c->plru[cache_type][set_idx], config->ways_n, free);
+        set_line(p, lines, set_idx, free, tag);
+        if(config->uses_plru) touch_plru(lines, set_idx, free);
+        if(lines->sharers) lines->sharers[line_idx(lines, set_idx, free)] = sim->config[start_id].dir_bit;
 
         return 1;
     }
@@ -415,35 +563,36 @@ char search_and_edit(int action, sim_t* sim, process_t* p, cache_t* c, char* evi
 }
 
 // either invalidates a line or sets a line, based on action
-void edit_line(int action, sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, cacheline_t* set, int set_idx, int way_idx) {
+void edit_line(int action, sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int way_idx) {
   
     // this cache line is either the line that is to be set or evicted 
-    cacheline_t* cl = &set[way_idx];
-    if(!cl->valid && action == EVICT_LINE) return; 
+    size_t line = line_idx(lines, set_idx, way_idx);
+    uint16_t meta = lines->meta[line];
+    if(!line_valid(meta) && action == EVICT_LINE) return; 
+    uint16_t sharers = 0; // directory ; see search_and_edit()
   
     if(sim->uses_inclusive) { // inclusive cache is used ; first evict/set line from all caches to maintain inclusive-ness
         
         // see which core to check
-        cache_t* c = NULL;  
+        core_t* core = NULL;  
         uint64_t addr;        
         int eid;
         int enclave_mode; 
         access_t* a = p->access; // if setting a line only
         
         if(action == EVICT_LINE) { // evict the victim cache line from all caches in the victim's core
-            int core_id = sim->eid_to_core_id[cl->eid];
-            core_t* core = &sim->cores[core_id]; // the core where this cache line originated
-            c = core->cache;
-            addr = get_addr(cl->tag, set_idx, config->offset_bits_n); // reconstruct the victim address
-            eid = cl->eid;
-            enclave_mode = cl->enclave_mode; 
+            int core_id = sim->eid_to_core_id[line_eid(meta)];
+            core = &sim->cores[core_id]; // the core where this cache line originated
+            addr = get_addr(lines->tags[line], set_idx, config->offset_bits_n); // reconstruct the victim address
+            eid = line_eid(meta);
+            enclave_mode = line_enclave_mode(meta); 
         } else if(action == SET_LINE) { // set the process's access in all caches
-            c = p->core->cache; // start from the beginning of this process's caches (L1) and go toward upper level caches
+            core = p->core; // start from the beginning of this process's caches (L1) and go toward upper level caches
             addr = a->addr;
             eid = p->eid;
             enclave_mode = a->enclave_mode; 
         }
-        assert(c != NULL);
+        assert(core != NULL);
  
         // if evicting a line from L3, we definitely need to evict from private level caches;
         // if evicting from private level, there is a chance that another private level cache has a copy, then we don't have to evict additional lines
@@ -451,32 +600,40 @@ void edit_line(int action, sim_t* sim, process_t* p, cache_t* c, cache_config_t*
         char start_is_inclu = config->inclu_policy == INCLUSIVE; 
         char evicted = 0;
 
-        // evict/set this line from other caches first 
+        // evict/set this line from other caches first ; in the private phase of quantum mode, shared caches are left alone
         char done = 0;
-        while(c && !done) {
-                    
-            if(c->unified) done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, UNIFIED_CACHE, eid, addr, enclave_mode);
+        int levels_n = (sim->private_phase) ? core->private_n : core->levels_n;
+        if(action == EVICT_LINE) {
+            sharers = DIR_ALL;
+            if(lines->sharers && config->dir_tracked[enclave_mode]) { // directory ; only these private caches can hold a copy
+                sharers = lines->sharers[line];
+                levels_n = core->private_n;
+            }
+        }
+        for(int i=0; i<levels_n && !done; i++) {
+            cache_t* c = core->levels[i].cache;
+            if(c->unified) done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, UNIFIED_CACHE, eid, addr, enclave_mode, &sharers);
             else { // must check both insn and data cache
-                done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, INSN_CACHE, eid, addr, enclave_mode); 
+                done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, INSN_CACHE, eid, addr, enclave_mode, &sharers); 
                 if(done) break;
-                done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, DATA_CACHE, eid, addr, enclave_mode); 
+                done = search_and_edit(action, sim, p, c, &evicted, config->id, start_is_inclu, DATA_CACHE, eid, addr, enclave_mode, &sharers); 
             }
-                
-            c = c->next;
         } 
     }
 
     // for inclusive and non-inclusive ; evict this line from the current cache
     if(action == EVICT_LINE) {
-        assert(cl->valid);
-        if(cl->dirty) update_stat(sim, p->nstat_counts, STAT_DIRTY_LINES, cl->enclave_mode);
-        if(cl->eid != p->eid) update_stat(sim, p->nstat_counts, STAT_EVICT_OTHER, cl->enclave_mode);
-        cl->valid = 0;
+        meta = lines->meta[line];
+        assert(line_valid(meta));
+        if(line_dirty(meta)) update_stat(sim, p->nstat_counts, STAT_DIRTY_LINES, line_enclave_mode(meta));
+        if(line_eid(meta) != p->eid) update_stat(sim, p->nstat_counts, STAT_EVICT_OTHER, line_enclave_mode(meta));
+        lines->meta[line] = meta & ~LINE_VALID;
     }
     else if(action == SET_LINE) {
         uint64_t tag = get_tag(p, config, p->access->addr);
-        set_line(p, cl, tag);
-        if(config->evict_policy == EVICT_PLRU || config->evict_policy == EVICT_SGX_PLRU) update_plru(c->plru[get_cache_type(c, p->access->op)][set_idx], config->ways_n, way_idx);
+        set_line(p, lines, set_idx, way_idx, tag);
+        if(config->uses_plru) touch_plru(lines, set_idx, way_idx);
+        if(lines->sharers) lines->sharers[line] = sharers; // the first level caches the walk placed it in
     }
 
 }
@@ -491,15 +648,15 @@ void invalidate_sets(sim_t* sim, process_t* p, cache_t* c, int cache_type, char
 	if(process_finished && sat[p->sat_idx].eid != p->eid) return; // can only clear its own partition 
 
 	int offset = p->offset_table[p->sat_idx][config->id];
-	int max = offset + pow(2, eway->set_bits_n);
+	int max = offset + (1 << eway->set_bits_n);
 
     int incr_ways = 1;
     if(config->use_cachelet && sim->cachelet_assoc >= 1) incr_ways = sim->cachelet_assoc;
 	
+    cache_lines_t* lines = &c->lines[cache_type];
 	for(int set_idx=offset; set_idx<max; set_idx++) { // for each set allocated to this enclave	
-        cacheline_t* set = c->cache[cache_type][set_idx];
         for(int w=0; w<incr_ways; w++) { // if using cachelet, remove line across associativity
-            edit_line(EVICT_LINE, sim, p, c, config, set, set_idx, p->eway_idx+w); // removes line in this cache ; if inclusive then it will remove from other cache levels 
+            edit_line(EVICT_LINE, sim, p, config, lines, set_idx, p->eway_idx+w); // removes line in this cache ; if inclusive then it will remove from other cache levels 
         }
 	}
 
@@ -546,7 +703,7 @@ int find_free_offset(sim_t* sim, process_t* p, cache_config_t* config) {
                     
                     if(!config->use_cachelet) { // dynamically change number of addressable sets if NOT using cachelet
 					    if( (eway->alloc_n != 0) && (eway->alloc_n & (eway->alloc_n - 1)) == 0) { // is a power of 2
-					    	eway->set_bits_n--;
+					    	set_eway_bits(config, eway, eway->set_bits_n - 1);
 					    }
                     }
 
@@ -568,13 +725,13 @@ int find_free_offset(sim_t* sim, process_t* p, cache_config_t* config) {
 			eway->valid = 1;
             // if cachelet is fixed
             if(config->use_cachelet) {
-                eway->set_bits_n = log2(config->sets_n/config->max_partition); // fixed, will not change
+                set_eway_bits(config, eway, log2(config->sets_n/config->max_partition)); // fixed, will not change
                 // update the bit map
                 for(int k=0; k<sim->cachelet_assoc; k++) {
                     set_way_bitmap(&config->way_bitmaps[0], w+k);
                 }
             } else {
-			    eway->set_bits_n = config->set_bits_n;
+			    set_eway_bits(config, eway, config->set_bits_n);
 			}
             eway->alloc_n = 1;
 		
@@ -596,12 +753,12 @@ void evict_sat_plru(sim_t* sim, process_t* p, cache_t* c, int cache_type) {
 	cache_config_t* config = c->config[cache_type];
 
 	// for now, pick a random victim way
-	p->eway_idx = rand() % config->enclave_ways_n;
+	p->eway_idx = rand_below(sim, config->enclave_ways_n);
 	enclave_way_info_t* eway = &config->eway_info[p->eway_idx];
 	sat_entry_t* sat = eway->sat;
 	char* plru = eway->sat_plru;	
 
-  	int t = log2(config->max_partition); // number of times we traverse the plru binary search tree
+  	int t = config->partition_bits_n; // number of times we traverse the plru binary search tree
   	int p_idx = 0; // index into plru bst   
   	int evict_idx = 0;
 
@@ -630,7 +787,7 @@ int get_enclave_set(sim_t* sim, process_t* p, cache_t* c, int cache_type, uint64
 	enclave_way_info_t* eway = &config->eway_info[p->eway_idx]; // obtain the assigned enclave way
 	sat_entry_t* sat = &eway->sat[p->sat_idx]; // obtain offset and set bits
 
-	if(sat->valid && sat->eid == p->eid) update_plru(eway->sat_plru, config->max_partition, p->sat_idx); 
+	if(sat->valid && sat->eid == p->eid) update_plru(eway->sat_plru, config->partition_bits_n, p->sat_idx); 
 	else {
 		// Process was replaced or this is first assignment
 		p->sat_idx = find_free_offset(sim, p, config); // find a free sat index and sets the appropriate bits	
@@ -640,12 +797,10 @@ int get_enclave_set(sim_t* sim, process_t* p, cache_t* c, int cache_type, uint64
     *tag = get_tag(p, config, addr);
 	
 	int offset = p->offset_table[p->sat_idx][config->id];
-	uint64_t set_mask = (uint64_t) pow(2, eway->set_bits_n) - 1;
-	set_mask = set_mask << (config->offset_bits_n);
-	int set_idx = (addr & set_mask) >> config->offset_bits_n; 
+	int set_idx = (addr & eway->set_mask) >> config->offset_bits_n; 
     
     // recalculate calculate partition factor
-    p->partition_factor = (int) pow(2, config->set_bits_n - eway->set_bits_n);
+    p->partition_factor = 1 << (config->set_bits_n - eway->set_bits_n);
 	
     set_idx = offset + set_idx;
 	return set_idx;
@@ -657,17 +812,11 @@ int get_dyn_enclave_set_and_tag(process_t* p, cache_t* c, int cache_type, uint64
     
     cache_config_t* config = c->config[cache_type];
     
-    // set
-    int set_bits_n = log2((config->sets_n/config->max_partition) * p->num_cachelets);
-    uint64_t set_mask = (uint64_t) pow(2, set_bits_n) - 1;
-    set_mask = set_mask << (config->offset_bits_n);
-    int set_idx = (addr & set_mask) >> config->offset_bits_n;
-     
-	// compute the tag    
-    int tag_bits_n = (config->addr_bits_n - (set_bits_n + config->offset_bits_n) );
-	uint64_t tag_mask = (uint64_t) pow(2, tag_bits_n) - 1;
-	tag_mask = tag_mask << (config->offset_bits_n + set_bits_n);
-	*tag = addr & tag_mask;
+    // num_cachelets doubles and halves ; its masks are in the tables of init_addressing()
+    int i = __builtin_ctz(p->num_cachelets);
+    assert(i <= config->partition_bits_n);
+    int set_idx = (addr & config->cachelet_set_masks[i]) >> config->offset_bits_n;
+	*tag = addr & config->cachelet_tag_masks[i];
 
     return set_idx;
 }
@@ -686,36 +835,20 @@ int evict_plru(cache_t* c, cache_config_t* config, int cache_type, int set_idx,
 	// no ways to search ; why did I need this again?
 	if(low_w == high_w) return -1;
 
-	char* plru = c->plru[cache_type][set_idx];
+    cache_lines_t* lines = &c->lines[cache_type];
+	uint64_t plru = *get_plru(lines, set_idx);
 
-	int t = log2(config->ways_n); // number of times we traverse the plru binary search tree
-    int p_idx = 0; // index into plru bst   
+    int node = 0; // index into plru bst
     int evict_idx = 0;
-
-    for(int i=t-1; i>=0; i--) {
-    	if(plru[p_idx] == 0) {
-    		if(!enclave_mode && ((i != 0) && ( evict_idx | (1 << (i-1)) ) < low_w)) { // checks if there is NOT a chance to find a non-enclave way in the sub-tree
-    			p_idx = 2*p_idx + 2; // must go to right child
-    			evict_idx |= (1 << i);
-    		} else if(!enclave_mode && (i == 0) && evict_idx < low_w) {
-    			p_idx = 2*p_idx + 2; // must go to right child
-    			evict_idx |= (1 << i);
-    		} else {
-    			plru[p_idx] = 1; // flip direction      
-    			p_idx = 2*p_idx + 1; // left child
-    		}
-    	}
-    	else { // go right
-    		if(enclave_mode && (evict_idx | (1 << i)) >= high_w) {
-    			// we have to go left without flipping bits
-    			p_idx = 2*p_idx + 1;
-    		} else {
-    			plru[p_idx] = 0; // flip direction
-    			p_idx = 2*p_idx + 2; // right child     
-    			evict_idx |= (1 << i);
-    		}
-    	}
-    } 
+    for(int i=lines->plru_levels-1; i>=0; i--) {
+        // non-enclave accesses go right if there is NOT a chance to find a non-enclave way in the left sub-tree ;
+        // enclave accesses go left if the right sub-tree starts past the enclave ways
+        int dir = ((plru >> node) & 1) | ((evict_idx | ((1 << i) >> 1)) < low_w);
+        dir &= ((evict_idx | (1 << i)) < high_w);
+        evict_idx |= dir << i;
+        node = 2*node + 1 + dir;
+    }
+    touch_plru(lines, set_idx, evict_idx); // every node on the path now points away from the victim
 	
     if(enclave_mode && config->partition) assert(evict_idx < config->enclave_ways_n);
 	else if(!enclave_mode && config->partition && config->enclave_ways_n > 0) assert(evict_idx >= config->enclave_ways_n);
@@ -726,47 +859,36 @@ int evict_plru(cache_t* c, cache_config_t* config, int cache_type, int set_idx,
 
 int evict_plru_cachelet(process_t* p, int cachelet_assoc, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode) {
  	
-	char* plru = c->plru[cache_type][set_idx];
+    cache_lines_t* lines = &c->lines[cache_type];
+	uint64_t* plru = get_plru(lines, set_idx);
 
-	int t = log2(config->ways_n); // number of times we traverse the plru binary search tree
-    int p_idx = 0; // index into plru bst   
+    int node = 0; // index into plru bst
     int evict_idx = 0;
     int assoc = config->ways_n; // search associativity
     
     if(enclave_mode) {
 
-        for(int i=t-1; i>=0; i--) {
-            if(assoc > cachelet_assoc) { // must force the search to go toward the enclave's cachelet, regardless of plru bits
-                if( p->eway_idx < (evict_idx | (1 << i)) ) { // the cachelet is on the left side
-                    //plru[p_idx] = 1; // flip direction so it points away from most-recently used
-                    p_idx = 2*p_idx + 1; // left child
-                } else { // cachelet is on the right side
-                   	//plru[p_idx] = 0; // flip direction
-        	    	p_idx = 2*p_idx + 2; // right child     
-        	    	evict_idx |= (1 << i);
-                }
-            }
-            else { // search space is completely inside cachelet; perform normal search and update plru bits
-        	    if(plru[p_idx] == 0) {
-        	    	plru[p_idx] = 1; // flip direction      
-        	    	p_idx = 2*p_idx + 1; // left child
-        	    }
-        	    else { // go right
-        	    	plru[p_idx] = 0; // flip direction
-        	    	p_idx = 2*p_idx + 2; // right child     
-        	    	evict_idx |= (1 << i);
-        	    }
-            }
+        uint64_t kept = 0; // nodes above the cachelet keep their bits
+        for(int i=lines->plru_levels-1; i>=0; i--) {
+            // must force the search to go toward the enclave's cachelet, regardless of plru bits ; once the search space
+            // is completely inside the cachelet, perform normal search and update plru bits
+            int forced = (assoc > cachelet_assoc);
+            int dir = forced ? ((p->eway_idx >> i) & 1) : ((*plru >> node) & 1);
+            kept |= (uint64_t) forced << node;
+            evict_idx |= dir << i;
+            node = 2*node + 1 + dir;
             assoc = (assoc >> 1); // search associativity splits in half
         } // for each traversal
+        plru_path_t* path = &plru_paths[lines->plru_levels][evict_idx];
+        *plru = (*plru & ~(path->mask & ~kept)) | (path->bits & ~kept);
 
     } else { // non-enclave mode
         
         uint64_t way_bitmap = config->way_bitmaps[get_way_bitmap_idx(config, set_idx)];
-        for(int i=t-1; i>=0; i--) {
+        for(int i=lines->plru_levels-1; i>=0; i--) {
             // first get the AND values of the left half and right half of the way_bitmap
             // the mask reads assoc/2 bits
-            uint64_t mask = (1 << (assoc >> 1)) - 1; // assoc >> 1 divides it by 2 ; +1 is so when you subtract 1, the other bits become 1 (want assoc/2 "1" bits)
+            uint64_t mask = (1ull << (assoc >> 1)) - 1; // assoc >> 1 divides it by 2 ; +1 is so when you subtract 1, the other bits become 1 (want assoc/2 "1" bits)
             uint64_t left = way_bitmap & mask; // way_bitmap is in the reverse order...
             uint64_t right = way_bitmap & (mask << (assoc >> 1));
 
@@ -775,36 +897,15 @@ int evict_plru_cachelet(process_t* p, int cachelet_assoc, cache_t* c, cache_conf
                 assert(0);
             }
 
-            // normal search
-            if(right != mask && left != mask) {
-                 if(plru[p_idx] == 0) {
-                 	plru[p_idx] = 1; // flip direction      
-        	        p_idx = 2*p_idx + 1; // left childi
-                    way_bitmap = left;
-                } else {
-                	plru[p_idx] = 0; // flip direction
-        	        p_idx = 2*p_idx + 2; // right child     
-        	        evict_idx |= (1 << i);
-                    way_bitmap = right;
-                }
-            } else { // one half is completely occupied by enclaves
-                if(right == mask) { // go left ; the right half is completely occupied by enclaves
-                 	plru[p_idx] = 1; // flip direction      
-        	        p_idx = 2*p_idx + 1; // left childi
-                    way_bitmap = left;
-                } else if(left == mask) { // go right ; the left half is completely occupied by enclaves
-                	plru[p_idx] = 0; // flip direction
-        	        p_idx = 2*p_idx + 2; // right child     
-        	        evict_idx |= (1 << i);
-                    way_bitmap = right;
-                } else {
-                    printf("right and left bits don't equal the mask\n");
-                    assert(0);
-                }
-            }
+            // normal search, unless one half is completely occupied by enclaves
+            int dir = (((*plru >> node) & 1) | (left == mask)) & (right != mask);
+            way_bitmap = dir ? right : left;
+            evict_idx |= dir << i;
+            node = 2*node + 1 + dir;
 
             assoc = (assoc >> 1); // search associativity splits in half
         } // for each traversal
+        touch_plru(lines, set_idx, evict_idx);
 
     }
 	
@@ -815,39 +916,35 @@ int evict_plru_cachelet(process_t* p, int cachelet_assoc, cache_t* c, cache_conf
 // this eviction policy favors enclave lines to stay in the cache ; the evict_idx is more likely to point to a non-enclave line
 int evict_sgx_plru(cache_t* c, cache_config_t* config, int cache_type, int set_idx) {
 
-    char* plru = c->plru[cache_type][set_idx];
+    cache_lines_t* lines = &c->lines[cache_type];
+    uint64_t* plru = get_plru(lines, set_idx);
+    int levels = lines->plru_levels;
 
-	int t = log2(config->ways_n); // number of times we traverse the plru binary search tree
-  	int p_idx = 0; // index into plru bst   
-  	int evict_idx = 0;
+    int evict_idx = 0;
+    int node = 0;
+    for(int i=levels-1; i>=0; i--) {
+        int dir = (*plru >> node) & 1;
+        evict_idx |= dir << i;
+        node = 2*node + 1 + dir;
+    }
 
-  	for(int i=t-1; i>=0; i--) {
-  	    
+    uint64_t kept = 0;
+    if(levels > 0) {
         // last level of plru ; bias (wants to evict non-enclave lines first)
-        if(i == 0) {
-            int left = evict_idx;
-            int right = evict_idx | (1 << i);
-            cacheline_t* set = c->cache[cache_type][set_idx];
-
-            // want to evict the non-enclave line first
-            if(set[left].enclave_mode != set[right].enclave_mode) {
-                if(!set[left].enclave_mode) evict_idx = left;
-                else evict_idx = right;
- 
-                break; 
-            }
-            // else, proceed as normally (pick PLRU)
-        } 
-        if(plru[p_idx] == 0) {
-  	        plru[p_idx] = 1; // set direction      
-  	     	p_idx = 2*p_idx + 1; // left child 
-  	     }
-  	     else { // go right
-  	        plru[p_idx] = 0; // set direction
-  	        p_idx = 2*p_idx + 2; // right child     
-  	        evict_idx |= (1 << i);  
-  	     }
-  	}
+        int left = evict_idx & ~1;
+        int right = evict_idx | 1;
+        int left_enclave = line_enclave_mode(lines->meta[line_idx(lines, set_idx, left)]);
+        int right_enclave = line_enclave_mode(lines->meta[line_idx(lines, set_idx, right)]);
+
+        // want to evict the non-enclave line first ; the last node is left alone
+        if(left_enclave != right_enclave) {
+            evict_idx = left_enclave ? right : left;
+            kept = 1ull << ((1 << (levels-1)) - 1 + (evict_idx >> 1));
+        }
+        // else, proceed as normally (pick PLRU)
+    }
+    plru_path_t* path = &plru_paths[levels][evict_idx];
+    *plru = (*plru & ~(path->mask & ~kept)) | (path->bits & ~kept);
 
     assert(evict_idx >= 0 && evict_idx < config->ways_n);	
     return evict_idx;	
@@ -857,6 +954,7 @@ int evict_sgx_plru(cache_t* c, cache_config_t* config, int cache_type, int set_i
 // returns the way where the line was evicted
 int pick_victim_way(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode) {
     int evict_idx = -1;
+    cache_lines_t* lines = &c->lines[cache_type];
     switch(config->evict_policy) {
         case EVICT_PLRU:
             if(config->use_cachelet && sim->cachelet_assoc >= 1) {
@@ -866,13 +964,13 @@ int pick_victim_way(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config
             break;
         case EVICT_SGX_PLRU:
             ;
-            float prob = (float) rand() / RAND_MAX;
+            double prob = rand_unit(sim);
             if(prob <= config->sgx_plru_rate) {
                 evict_idx = evict_sgx_plru(c, config, cache_type, set_idx); 
-                update_stat(sim, c->nstat_counts[cache_type], STAT_EVICT_SGX_PLRU, c->cache[cache_type][set_idx][evict_idx].enclave_mode);
+                update_stat(sim, c->nstat_counts[cache_type], STAT_EVICT_SGX_PLRU, line_enclave_mode(lines->meta[line_idx(lines, set_idx, evict_idx)]));
             } else {
                 evict_idx = evict_plru(c, config, cache_type, set_idx, enclave_mode);
-                update_stat(sim, c->nstat_counts[cache_type], STAT_EVICT_PLRU, c->cache[cache_type][set_idx][evict_idx].enclave_mode);
+                update_stat(sim, c->nstat_counts[cache_type], STAT_EVICT_PLRU, line_enclave_mode(lines->meta[line_idx(lines, set_idx, evict_idx)]));
             } 
             break;
         default:
@@ -882,16 +980,81 @@ int pick_victim_way(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config
     return evict_idx;
 }
 
+// compares every way of a set at once ; bit w of *hits: way w holds a valid line with this tag and match (the eid
+// and enclave mode, see line_meta), bit w of *frees: way w is invalid. The arrays are padded past the last set by
+// MATCH_WAYS lines, so bits past ways_n are set from padding or the next set and must be masked by the caller
+#if defined(__AVX2__) && !defined(SCALAR_SEARCH)
+static void match_set(uint64_t* tags, uint16_t* meta, int ways_n, uint64_t tag, uint16_t match, uint64_t* hits, uint64_t* frees) {
+    __m256i t = _mm256_set1_epi64x((long long) tag);
+    __m128i m_match = _mm_set1_epi16((short) match);
+    __m128i m_clean = _mm_set1_epi16((short) ~LINE_DIRTY);
+    __m128i m_valid = _mm_set1_epi16(LINE_VALID);
+    __m128i zero = _mm_setzero_si128();
+    *hits = 0;
+    *frees = 0;
+    for(int w=0; w<ways_n; w+=MATCH_WAYS) {
+        __m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) &tags[w]), t);
+        __m256i hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) &tags[w+4]), t);
+        uint64_t tag_hits = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+
+        __m128i m = _mm_loadu_si128((__m128i*) &meta[w]);
+        __m128i eq = _mm_cmpeq_epi16(_mm_and_si128(m, m_clean), m_match);
+        __m128i invalid = _mm_cmpeq_epi16(_mm_and_si128(m, m_valid), zero);
+        uint64_t meta_hits = _mm_movemask_epi8(_mm_packs_epi16(eq, zero)); // one byte per way
+        *hits |= (tag_hits & meta_hits) << w;
+        *frees |= (uint64_t) _mm_movemask_epi8(_mm_packs_epi16(invalid, zero)) << w;
+    }
+}
+#elif defined(__SSE2__) && !defined(SCALAR_SEARCH)
+static void match_set(uint64_t* tags, uint16_t* meta, int ways_n, uint64_t tag, uint16_t match, uint64_t* hits, uint64_t* frees) {
+    __m128i t = _mm_set1_epi64x((long long) tag);
+    __m128i m_match = _mm_set1_epi16((short) match);
+    __m128i m_clean = _mm_set1_epi16((short) ~LINE_DIRTY);
+    __m128i m_valid = _mm_set1_epi16(LINE_VALID);
+    __m128i zero = _mm_setzero_si128();
+    *hits = 0;
+    *frees = 0;
+    for(int w=0; w<ways_n; w+=MATCH_WAYS) {
+        uint64_t tag_hits = 0;
+        for(int i=0; i<MATCH_WAYS; i+=2) { // SSE2 has no 64-bit compare ; both 32-bit halves of a tag must match
+            __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &tags[w+i]), t);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            tag_hits |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+        }
+
+        __m128i m = _mm_loadu_si128((__m128i*) &meta[w]);
+        __m128i eq = _mm_cmpeq_epi16(_mm_and_si128(m, m_clean), m_match);
+        __m128i invalid = _mm_cmpeq_epi16(_mm_and_si128(m, m_valid), zero);
+        uint64_t meta_hits = _mm_movemask_epi8(_mm_packs_epi16(eq, zero)); // one byte per way
+        *hits |= (tag_hits & meta_hits) << w;
+        *frees |= (uint64_t) _mm_movemask_epi8(_mm_packs_epi16(invalid, zero)) << w;
+    }
+}
+#else
+// scalar reference
+static void match_set(uint64_t* tags, uint16_t* meta, int ways_n, uint64_t tag, uint16_t match, uint64_t* hits, uint64_t* frees) {
+    *hits = 0;
+    *frees = 0;
+    for(int w=0; w<ways_n; w++) {
+        if((meta[w] & ~LINE_DIRTY) == match && tags[w] == tag) *hits |= 1ull << w;
+        if(!line_valid(meta[w])) *frees |= 1ull << w;
+    }
+}
+#endif
+
 // returns the way where the cache line is ; if there is a free splot, free is set
-int search_set(sim_t* sim, process_t* p, cache_config_t* config, cacheline_t* set, int set_idx, int* free, int eid, uint64_t tag) {
+// handles every partitioning scheme ; config->lookup[] has the routine for the common ones
+int search_set(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
 
-    int enclave_mode = p->access->enclave_mode;
+    size_t set = line_idx(lines, set_idx, 0);
+    uint64_t* tags = &lines->tags[set];
+    uint16_t* meta = &lines->meta[set];
 	
 	if( (enclave_mode && config->set_partition && !config->use_cachelet) || 
         (enclave_mode && config->use_cachelet && sim->cachelet_assoc <= 1) ) { // direct-mapped
-        cacheline_t* cl = &set[p->eway_idx];
-        if(cl->valid && cl->tag == tag && cl->eid == p->eid) return p->eway_idx; // cache hit
-		else if(!cl->valid) *free = p->eway_idx;
+        int w = p->eway_idx;
+        if(line_valid(meta[w]) && tags[w] == tag && line_eid(meta[w]) == p->eid) return w; // cache hit
+		else if(!line_valid(meta[w])) *free = w;
         return -1; 
 	}
 
@@ -910,47 +1073,175 @@ int search_set(sim_t* sim, process_t* p, cache_config_t* config, cacheline_t* se
 	    } 
     }
 
-    *free = -1;
-    uint64_t* way_bitmap = &config->way_bitmaps[get_way_bitmap_idx(config, set_idx)];
-	for(int w=low_w; w<high_w; w++) {
-		cacheline_t* cl = &set[w];
-        if(config->use_cachelet && !enclave_mode && read_way_bitmap(way_bitmap, w)) {
-            continue; // must check if the way is allocated to an enclave
-        }
-        
-	    if(!cl->valid && *free == -1) *free = w;
-        if(cl->valid && cl->enclave_mode == enclave_mode && cl->tag == tag && cl->eid == eid) return w;
-        
-	}	
-	
+    uint64_t ways = ((high_w >= 64) ? ~0ull : (1ull << high_w) - 1) & ~((1ull << low_w) - 1);
+    if(config->use_cachelet && !enclave_mode) ways &= ~config->way_bitmaps[get_way_bitmap_idx(config, set_idx)]; // skip ways allocated to enclaves
+
+    uint64_t hits, frees;
+    match_set(tags, meta, high_w, tag, line_meta(eid, enclave_mode, 0), &hits, &frees); // a valid line of this process and mode ; dirty or not
+    hits &= ways;
+    frees &= ways & ((hits & -hits) - 1); // a free way is reported up to the hit, as the search stops there
+    *free = frees ? __builtin_ctzll(frees) : -1;
+    return hits ? __builtin_ctzll(hits) : -1;
+
+}
+
+/* set lookups ; config->lookup[], same results as search_set() for the ways of each access path */
+
+static inline uint64_t way_range(int low_w, int high_w) {
+    return ((high_w >= 64) ? ~0ull : (1ull << high_w) - 1) & ~((1ull << low_w) - 1);
+}
+
+// searches the ways in the ways bitmap (below high_w) ; set is the line of way 0
+static inline int lookup_ways(cache_lines_t* lines, size_t set, int high_w, uint64_t ways, int* free, int eid, int enclave_mode, uint64_t tag) {
+    uint64_t hits, frees;
+    match_set(&lines->tags[set], &lines->meta[set], high_w, tag, line_meta(eid, enclave_mode, 0), &hits, &frees);
+    hits &= ways;
+    frees &= ways & ((hits & -hits) - 1); // a free way is reported up to the hit, as the search stops there
+    *free = frees ? __builtin_ctzll(frees) : -1;
+    return hits ? __builtin_ctzll(hits) : -1;
+}
+
+static int lookup_all(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) sim; (void) p;
+    return lookup_ways(lines, line_idx(lines, set_idx, 0), config->ways_n, way_range(0, config->ways_n), free, eid, enclave_mode, tag);
+}
+
+static int lookup_enclave_ways(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) sim; (void) p;
+    return lookup_ways(lines, line_idx(lines, set_idx, 0), config->enclave_ways_n, way_range(0, config->enclave_ways_n), free, eid, enclave_mode, tag);
+}
+
+static int lookup_other_ways(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) sim; (void) p;
+    return lookup_ways(lines, line_idx(lines, set_idx, 0), config->ways_n, way_range(config->enclave_ways_n, config->ways_n), free, eid, enclave_mode, tag);
+}
+
+static int lookup_cachelet(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) config;
+    int high_w = p->eway_idx + sim->cachelet_assoc;
+    return lookup_ways(lines, line_idx(lines, set_idx, 0), high_w, way_range(p->eway_idx, high_w), free, eid, enclave_mode, tag);
+}
+
+// non-enclave accesses skip the ways allocated to cachelets
+static int lookup_outside_cachelets(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) sim; (void) p;
+    uint64_t ways = way_range(0, config->ways_n) & ~config->way_bitmaps[get_way_bitmap_idx(config, set_idx)];
+    return lookup_ways(lines, line_idx(lines, set_idx, 0), config->ways_n, ways, free, eid, enclave_mode, tag);
+}
+
+// enclave lines of a set partition or a one way cachelet ; only the process's way is looked at
+static int lookup_direct(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) {
+    (void) sim; (void) config; (void) eid; (void) enclave_mode;
+    size_t line = line_idx(lines, set_idx, p->eway_idx);
+    if(line_valid(lines->meta[line]) && lines->tags[line] == tag && line_eid(lines->meta[line]) == p->eid) return p->eway_idx; // cache hit
+    if(!line_valid(lines->meta[line])) *free = p->eway_idx;
     return -1;
+}
+
+/* victim ways ; config->victim[] */
 
+static int victim_direct(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode) {
+    (void) sim; (void) c; (void) config; (void) cache_type; (void) set_idx; (void) enclave_mode;
+    return p->eway_idx;
 }
 
-int search_cache(int action, sim_t* sim, process_t* p, cache_t* c, int* free) {
+static int victim_plru(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode) {
+    (void) sim; (void) p;
+    return evict_plru(c, config, cache_type, set_idx, enclave_mode);
+}
+
+static int victim_plru_cachelet(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode) {
+    return evict_plru_cachelet(p, sim->cachelet_assoc, c, config, cache_type, set_idx, enclave_mode);
+}
+
+#ifdef FIXED_GEOMETRY
+/* sgxc-fixed: set index and lookup of each cache with its geometry as constants ; bound in place of index_plain() and lookup_all() */
+
+#define FIXED_SET_MASK(set_bits_n, offset_bits_n) (((1ull << (set_bits_n)) - 1) << (offset_bits_n))
+#define FIXED_TAG_MASK(set_bits_n, offset_bits_n) ((~0ull >> (64 - ADDR_BITS)) & (~0ull << ((set_bits_n) + (offset_bits_n))))
+
+#define FIXED_PATH(id, sets_n, ways_n, offset_bits_n, set_bits_n) \
+static int index_fixed_##id(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, uint64_t* tag) { \
+    (void) sim; (void) p; (void) c; (void) cache_type; (void) config; \
+    *tag = addr & FIXED_TAG_MASK(set_bits_n, offset_bits_n); \
+    return (addr & FIXED_SET_MASK(set_bits_n, offset_bits_n)) >> (offset_bits_n); \
+} \
+static int lookup_fixed_##id(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag) { \
+    (void) sim; (void) p; (void) config; \
+    return lookup_ways(lines, (size_t) set_idx * (ways_n), ways_n, way_range(0, ways_n), free, eid, enclave_mode, tag); \
+}
+FIXED_CACHES(FIXED_PATH)
+
+typedef struct fixed_path_t {
+    int sets_n;
+    int ways_n;
+    int offset_bits_n;
+    index_fn_t index;
+    lookup_fn_t lookup;
+} fixed_path_t;
+
+#define FIXED_ENTRY(id, sets_n, ways_n, offset_bits_n, set_bits_n) {sets_n, ways_n, offset_bits_n, index_fixed_##id, lookup_fixed_##id},
+static const fixed_path_t fixed_paths[FIXED_CONFIGS_N] = { FIXED_CACHES(FIXED_ENTRY) };
+
+static void bind_fixed_path(cache_config_t* c) {
+    const fixed_path_t* f = &fixed_paths[c->id];
+    if(f->sets_n != c->sets_n || f->ways_n != c->ways_n || f->offset_bits_n != c->offset_bits_n) {
+        printf("%s: this sgxc was built for the caches of %s ; use the generic sgxc\n", c->name, FIXED_CONFIG_FILE);
+        exit(1);
+    }
+    for(int mode=NON_ENCLAVE; mode<=ENCLAVE; mode++) {
+        if(c->index[mode] == index_plain && !c->set_partition) c->index[mode] = f->index; // get_tag() needs the enclave way of set partitions
+        if(c->lookup[mode] == lookup_all) c->lookup[mode] = f->lookup;
+    }
+}
+#endif
+
+// picks the routines of a cache once, so an access does not test the partitioning scheme at every step
+static void bind_access_path(sim_t* sim, cache_config_t* c) {
+
+    char direct = (c->set_partition && !c->use_cachelet) || (c->use_cachelet && sim->cachelet_assoc <= 1); // direct-mapped for enclaves
+
+    c->index[NON_ENCLAVE] = index_plain;
+    if(c->use_cachelet && sim->dyn_threshold > 0) c->index[ENCLAVE] = index_dyn_cachelet;
+    else if(c->set_partition) c->index[ENCLAVE] = index_enclave_set;
+    else c->index[ENCLAVE] = index_plain;
+
+    if(c->use_cachelet) c->lookup[NON_ENCLAVE] = (c->partition && sim->cachelet_assoc <= 1) ? search_set : lookup_outside_cachelets;
+    else c->lookup[NON_ENCLAVE] = (c->partition) ? lookup_other_ways : lookup_all;
+    if(direct) c->lookup[ENCLAVE] = lookup_direct;
+    else if(c->use_cachelet) c->lookup[ENCLAVE] = lookup_cachelet;
+    else c->lookup[ENCLAVE] = (c->partition) ? lookup_enclave_ways : lookup_all;
+
+    for(int mode=NON_ENCLAVE; mode<=ENCLAVE; mode++) {
+        if(mode == ENCLAVE && direct) c->victim[mode] = victim_direct;
+        else if(c->evict_policy == EVICT_PLRU) c->victim[mode] = (c->use_cachelet && sim->cachelet_assoc >= 1) ? victim_plru_cachelet : victim_plru;
+        else c->victim[mode] = pick_victim_way; // sgx_plru picks its policy at every eviction
+    }
+    c->uses_plru = (c->evict_policy == EVICT_PLRU || c->evict_policy == EVICT_SGX_PLRU);
+    c->fast_hit[NON_ENCLAVE] = 1;
+    c->fast_hit[ENCLAVE] = !c->set_partition && !(c->use_cachelet && (sim->dyn_threshold > 0 || sim->dyn_downsize_threshold > 0));
+#ifdef FIXED_GEOMETRY
+    bind_fixed_path(c);
+#endif
+}
+
+int search_cache(int action, sim_t* sim, process_t* p, level_t* l, int* free) {
    
     access_t* a = p->access;
-     
-    int cache_type = get_cache_type(c, a->op); // data, insn, or unifid	
+    cache_t* c = l->cache;
+    int cache_type = l->type[a->op]; // data, insn, or unifid	
 	cache_config_t* config = c->config[cache_type];
+    int enclave_mode = a->enclave_mode;
  
 	uint64_t tag;
-	int set_idx = get_set_and_tag(sim, p, c, cache_type, config, a->addr, a->enclave_mode, &tag);
+	int set_idx = config->index[enclave_mode](sim, p, c, cache_type, config, a->addr, &tag);
 	
     *free = -1;
-    int hit = -1;	
-    cacheline_t* set = c->cache[cache_type][set_idx];	
-	
-    if(     (a->enclave_mode && config->set_partition && !config->use_cachelet) || 
-            (a->enclave_mode && config->use_cachelet && sim->cachelet_assoc <= 1) ) { // no need to search the ways ; is a direct-mapped cache
-        cacheline_t* cl = &set[p->eway_idx];
-        if(cl->valid && cl->tag == tag && cl->eid == p->eid) hit = p->eway_idx; // cache hit
-        else if(!cl->valid) *free = p->eway_idx;
-    } else hit = search_set(sim, p, config, set, set_idx, free, p->eid, tag);
-    
+    cache_lines_t* lines = &c->lines[cache_type];
+    int hit = config->lookup[enclave_mode](sim, p, config, lines, set_idx, free, p->eid, enclave_mode, tag);
     
     if(hit != -1) { // cache hit
-         if(config->evict_policy == EVICT_PLRU || config->evict_policy == EVICT_SGX_PLRU) update_plru(c->plru[cache_type][set_idx], config->ways_n, hit);
+         if(config->uses_plru) touch_plru(lines, set_idx, hit);
          return hit;
     }
 
@@ -958,63 +1249,79 @@ int search_cache(int action, sim_t* sim, process_t* p, cache_t* c, int* free) {
     
     if(action == PLACE_LINE) { // there was no free spot ; must evict
         if(*free != -1) { // free spot in the cache
-            edit_line(SET_LINE, sim, p, c, config, set, set_idx, *free); // sets a line in this cache ; if inclusive then it will set in other cache levels	
+            edit_line(SET_LINE, sim, p, config, lines, set_idx, *free); // sets a line in this cache ; if inclusive then it will set in other cache levels	
         } else {
-            int evict_idx;
-            if( (a->enclave_mode && config->set_partition && !config->use_cachelet) || 
-                (a->enclave_mode && config->use_cachelet && sim->cachelet_assoc <= 1) ) evict_idx = p->eway_idx; // direct-mapped
-            else {
-                evict_idx = pick_victim_way(sim, p, c, config, cache_type, set_idx, a->enclave_mode);
-            }
-
-            edit_line(EVICT_LINE, sim, p, c, config, set, set_idx, evict_idx); // removes line in this cache ; if inclusive then it will remove from other cache levels	
-            edit_line(SET_LINE, sim, p, c, config, set, set_idx, evict_idx); // sets a line in this cache ; if inclusive then it will set in other cache levels	
+            int evict_idx = config->victim[enclave_mode](sim, p, c, config, cache_type, set_idx, enclave_mode); // direct-mapped or plru
+            edit_line(EVICT_LINE, sim, p, config, lines, set_idx, evict_idx); // removes line in this cache ; if inclusive then it will remove from other cache levels	
+            edit_line(SET_LINE, sim, p, config, lines, set_idx, evict_idx); // sets a line in this cache ; if inclusive then it will set in other cache levels	
         }
     }
     return hit;
 }
 
-void access_cache(sim_t* sim, process_t* p) {
-     
-	core_t* core = p->core;	
-	cache_t* c = core->cache; // first level private cache
+// places the next line (or two) into every cache after a last level cache miss
+static void prefetch_lines(sim_t* sim, process_t* p) {
+    if(sim->prefetch == nextLine || sim->prefetch == nextTwoLines) {
+        int rounds = sim->prefetch; // either 1 or 2
+        uint64_t addr = p->access->addr;
+        int free = -1;
+        for(int i=0; i<p->core->levels_n; i++) { // place line in all caches
+            level_t* l = &p->core->levels[i];
+            int line_size = l->cache->config[l->type[p->access->op]]->line_size;
+            for(int r=0; r<rounds; r++) {
+                p->access->addr += line_size; // update address
+                search_cache(PLACE_LINE, sim, p, l, &free);
+            }
+            p->access->addr = addr; // restore original address for next level of cache
+        }
+    }
+}
+
+// searches the levels of p's core from first up to (not including) end ; returns 1 if the access missed in all of them
+// deferred: quantum mode placed the line into the first level cache already ; l1_cold: it went into a free way
+static char access_levels(sim_t* sim, process_t* p, int first, int end, char deferred, char l1_cold) {
 
     access_t* a = p->access;
     int enclave_mode = a->enclave_mode;
     int op = a->op;
-   
-    // stats 
-    update_stat_mem_access(sim, p->nstat_counts, op, enclave_mode);
+    level_t* levels = p->core->levels;
 	
-    while(c) { // search each level of cache
+    for(int i=first; i<end; i++) { // search each level of cache
         
-        int cache_type = get_cache_type(c, op); // data, insn, or unified	
+        level_t* l = &levels[i];
+        cache_t* c = l->cache;
+        int cache_type = l->type[op]; // data, insn, or unified	
 		cache_config_t* config = c->config[cache_type];
+        if(c == sim->cache && (sim->mrc || p->shards)) mrc_access(sim, p); // missed in every private cache
 
         // stats 
         update_stat_mem_access(sim, c->nstat_counts[cache_type], op, enclave_mode);
-        if(!c->next) update_stat(sim, p->nstat_counts, STAT_LLC_ACCESS, enclave_mode);
+        if(l->llc) update_stat(sim, p->nstat_counts, STAT_LLC_ACCESS, enclave_mode);
        
         int free = -1;
         int hit = -1;
 
-        hit = search_cache(SEARCH_LINE, sim, p, c, &free); // searches the cache ; hits update plru
+        hit = search_cache(SEARCH_LINE, sim, p, l, &free); // searches the cache ; hits update plru
+        if(sim->warmup_window && sim->trace_n < sim->start_stat) {
+            c->warm_accesses[cache_type]++;
+            if(hit == -1) c->warm_misses[cache_type]++;
+        }
         // stats partition factor time
         if(config->set_partition) update_stat_partition_time(sim, p->nstat_counts, p->partition_factor, enclave_mode);
 
 		if(hit != -1) {
             // stats
             update_stat_all(sim, c, cache_type, p, STAT_CACHE_HIT, enclave_mode);
-            if(!c->next) update_stat(sim, p->nstat_counts, STAT_LLC_HIT, enclave_mode);
+            if(l->llc) update_stat(sim, p->nstat_counts, STAT_LLC_HIT, enclave_mode);
 			
-            if(config->level != 1) search_cache(PLACE_LINE, sim, p, p->core->cache, &free); // place into first level cache
+            if(config->level != 1 && !deferred) search_cache(PLACE_LINE, sim, p, &levels[0], &free); // place into first level cache
 			//break;
 		} 
         else { // cache miss
             // stats
             update_stat(sim, c->nstat_counts[cache_type], STAT_CACHE_MISS, enclave_mode);
             
-            if(c->next == NULL) { // last level cache ; put line into all caches	
+            if(l->llc) { // last level cache ; put line into all caches	
                 // stats
                 update_stat(sim, p->nstat_counts, STAT_CACHE_MISS, enclave_mode);
                 if(free != -1) update_stat(sim, p->nstat_counts, STAT_LLC_COLD_MISS, enclave_mode);
@@ -1024,30 +1331,18 @@ void access_cache(sim_t* sim, process_t* p) {
                     if(op == LOAD_OP || op == STORE_OP) p->miss_counter++;
                 }
 
-                cache_t* cache_ptr = p->core->cache;	
-				while(cache_ptr) { // place line in all caches
-				    search_cache(PLACE_LINE, sim, p, cache_ptr, &free);
-                    if(free != -1) update_stat(sim, cache_ptr->nstat_counts[get_cache_type(cache_ptr, op)], STAT_CACHE_COLD_MISS, enclave_mode);
-                    cache_ptr = cache_ptr->next;
+                int j = 0;	
+                if(deferred) { // already in the first level cache
+                    if(l1_cold) update_stat(sim, levels[0].cache->nstat_counts[levels[0].type[op]], STAT_CACHE_COLD_MISS, enclave_mode);
+                    j = 1;
+                }
+				for(; j<p->core->levels_n; j++) { // place line in all caches
+				    search_cache(PLACE_LINE, sim, p, &levels[j], &free);
+                    if(free != -1) update_stat(sim, levels[j].cache->nstat_counts[levels[j].type[op]], STAT_CACHE_COLD_MISS, enclave_mode);
 				}
                 
                 // prefetch lines on a cache miss
-                if(sim->prefetch) {
-                    if(sim->prefetch == nextLine || sim->prefetch == nextTwoLines) {
-                        cache_t* cache_ptr = p->core->cache;
-                        int rounds = sim->prefetch; // either 1 or 2
-				        uint64_t addr = p->access->addr;
-                        while(cache_ptr) { // place line in all caches
-                            int line_size = cache_ptr->config[get_cache_type(cache_ptr, op)]->line_size;
-                            for(int r=0; r<rounds; r++) {
-                                p->access->addr += line_size; // update address
-                                search_cache(PLACE_LINE, sim, p, cache_ptr, &free);
-                            }
-                            p->access->addr = addr; // restore original address for next level of cache
-                            cache_ptr = cache_ptr->next;
-				        }
-                    }
-                } // if(sim->prefetch)
+                if(sim->prefetch) prefetch_lines(sim, p);
 			} // last level cache
 
             // dynamic cachelets
@@ -1101,9 +1396,8 @@ void access_cache(sim_t* sim, process_t* p) {
                     // clear the cache space first
                     int sets_n = (config->sets_n/config->max_partition) * p->num_cachelets;
                     for(int s=0; s<sets_n; s++) {
-                        cacheline_t* set = c->cache[cache_type][s];
                         for(int w=0; w<sim->cachelet_assoc; w++) {
-                            edit_line(EVICT_LINE, sim, p, c, config, set, s, w); // removes line in this cache ; if inclusive then it will remove from other cache levels	
+                            edit_line(EVICT_LINE, sim, p, config, &c->lines[cache_type], s, w); // removes line in this cache ; if inclusive then it will remove from other cache levels	
                         }
                     }
                     p->num_cachelets /= 2; // halven the amount of cachelets
@@ -1124,9 +1418,8 @@ void access_cache(sim_t* sim, process_t* p) {
                     // clear the increased cache space
                     int sets_n = (config->sets_n/config->max_partition) * p->num_cachelets;
                     for(int s=0; s<sets_n; s++) {
-                        cacheline_t* set = c->cache[cache_type][s];
                         for(int w=0; w<sim->cachelet_assoc; w++) {
-                            edit_line(EVICT_LINE, sim, p, c, config, set, s, w); // removes line in this cache ; if inclusive then it will remove from other cache levels	
+                            edit_line(EVICT_LINE, sim, p, config, &c->lines[cache_type], s, w); // removes line in this cache ; if inclusive then it will remove from other cache levels	
                             //set[w].valid = 0;
                         }
                     }
@@ -1139,15 +1432,153 @@ void access_cache(sim_t* sim, process_t* p) {
                 set_stat_count(p->nstat_counts, STAT_MAX_MISS_COUNTER, enclave_mode, p->miss_counter);
             }
 
-            if(sim->trace_n >= START_STAT) {
+            if(sim->trace_n >= sim->start_stat) {
                 fprintf(sim->miss_csv, "%s,%i,%i,%" PRIu64 ",%" PRIu64 "\n", p->tracefile->filename, p->eid, p->num_cachelets, e_insn, p->miss_counter);
             }
             p->miss_counter = 0; // reset
         }
        
-        if(hit != -1) break;
-        c = c->next;
+        if(hit != -1) return 0;
+
+	} // for each level ; end
+
+    return 1;
+}
+
+// warmup of the levels of p's core from first on ; first > 0: the line is in the first level cache already
+static void warm_levels(sim_t* sim, process_t* p, int first) {
+
+    access_t* a = p->access;
+    core_t* core = p->core;
+    int free = -1;
+    for(int i=first; i<core->levels_n; i++) {
+        level_t* l = &core->levels[i];
+        cache_t* c = l->cache;
+        if(c == sim->cache && (sim->mrc || p->shards)) mrc_access(sim, p); // missed in every private cache
+
+        int cache_type = l->type[a->op];
+        int hit = search_cache(SEARCH_LINE, sim, p, l, &free); // hits update plru
+        if(sim->warmup_window) {
+            c->warm_accesses[cache_type]++;
+            if(hit == -1) c->warm_misses[cache_type]++;
+        }
+        if(hit != -1) {
+            if(first == 0 && c->config[cache_type]->level != 1) search_cache(PLACE_LINE, sim, p, &core->levels[0], &free); // place into first level cache
+            return;
+        }
+    }
+
+    // missed in every cache ; put line into all caches
+    level_t* llc = &core->levels[core->levels_n-1];
+    cache_config_t* config = llc->cache->config[llc->type[a->op]];
+    if(sim->dyn_threshold > 0 && config->use_cachelet && a->enclave_mode && (a->op == LOAD_OP || a->op == STORE_OP)) p->miss_counter++;
+
+    for(int i=first; i<core->levels_n; i++) search_cache(PLACE_LINE, sim, p, &core->levels[i], &free);
+    if(sim->prefetch) prefetch_lines(sim, p);
+}
+
+// warmup (trace_n < start_stat): makes the same changes to the caches as access_cache(), without statistics ;
+// statistics are not counted before start_stat anyway
+void warm_cache(sim_t* sim, process_t* p) {
+    warm_levels(sim, p, 0);
+}
+
+// most accesses hit in the first level cache ; such a hit gets the same statistics and PLRU update as in access_levels(),
+// without its checks for other levels, partitions and dynamic cachelets ; returns 0 on a miss, with nothing changed
+static inline char l1_hit(sim_t* sim, process_t* p) {
+
+    access_t* a = p->access;
+    level_t* l = &p->core->levels[0];
+    if(!l->fast) return 0;
+    cache_t* c = l->cache;
+    int cache_type = l->type[a->op];
+    cache_config_t* config = c->config[cache_type];
+    int enclave_mode = a->enclave_mode;
+    if(!config->fast_hit[enclave_mode]) return 0;
+
+    uint64_t tag;
+    int set_idx = config->index[enclave_mode](sim, p, c, cache_type, config, a->addr, &tag);
+    cache_lines_t* lines = &c->lines[cache_type];
+    int free = -1;
+    int hit = config->lookup[enclave_mode](sim, p, config, lines, set_idx, &free, p->eid, enclave_mode, tag);
+    if(hit == -1) return 0;
+    if(config->uses_plru) touch_plru(lines, set_idx, hit);
+
+    if(sim->trace_n >= sim->start_stat) { // update_stat_mem_access() of the process and the cache, then update_stat_all()
+        int event = mem_access_event(a->op);
+        nstat_count_t* process_counts = p->nstat_counts;
+        nstat_count_t* cache_counts = c->nstat_counts[cache_type];
+        process_counts[event].count[enclave_mode]++;
+        process_counts[STAT_TRACE].count[enclave_mode]++;
+        process_counts[STAT_CACHE_HIT].count[enclave_mode]++;
+        cache_counts[event].count[enclave_mode]++;
+        cache_counts[STAT_TRACE].count[enclave_mode]++;
+        cache_counts[STAT_CACHE_HIT].count[enclave_mode]++;
+        p->core->nstat_counts[STAT_CACHE_HIT].count[enclave_mode]++;
+    } else if(sim->warmup_window) c->warm_accesses[cache_type]++; // detailed warmup
+    return 1;
+}
+
+void access_cache(sim_t* sim, process_t* p) {
+   
+    if(l1_hit(sim, p)) return;
+
+    // stats 
+    update_stat_mem_access(sim, p->nstat_counts, p->access->op, p->access->enclave_mode);
+
+    access_levels(sim, p, 0, p->core->levels_n, 0, 0); // from the first level private cache
+}
+
+// quantum mode: searches the private caches only ; returns 1 if the access must continue to the shared caches
+// a line that missed in every private cache is placed into the first level cache right away, as if it hit in a shared cache ;
+// *l1_cold is set if it went into a free way
+char access_private(sim_t* sim, process_t* p, char* l1_cold) {
+   
+    *l1_cold = 0;
+    if(l1_hit(sim, p)) return 0;
+
+    // stats 
+    update_stat_mem_access(sim, p->nstat_counts, p->access->op, p->access->enclave_mode);
 
-	} // while(c) ; end
+    core_t* core = p->core;
+    if(core->private_n == 0) return 1; // no private caches
+    if(!access_levels(sim, p, 0, core->private_n, 0, 0)) return 0;
+    if(!sim->cache) return 0; // without shared caches, the walk already placed the line
+
+    int free = -1;
+    search_cache(PLACE_LINE, sim, p, &core->levels[0], &free);
+    *l1_cold = (free != -1);
+    return 1;
+}
+
+// quantum mode: continues an access that missed in every private cache ; on a miss the line goes into the remaining caches
+void access_shared(sim_t* sim, process_t* p, char l1_cold) {
+    core_t* core = p->core;
+    access_levels(sim, p, core->private_n, core->levels_n, core->private_n > 0, l1_cold);
+}
+
+// strict mode on worker threads (see sweep.h): the first level cache part of access_cache(), or of warm_cache() if warm ;
+// returns 1 if the access missed there, after placing the line into it (*l1_cold: into a free way) as access_cache() would
+char access_first_level(sim_t* sim, process_t* p, char warm, char* l1_cold) {
+
+    level_t* l = &p->core->levels[0];
+    int free = -1;
+    *l1_cold = 0;
+    if(warm) {
+        if(search_cache(SEARCH_LINE, sim, p, l, &free) != -1) return 0; // hits update plru
+    } else {
+        if(l1_hit(sim, p)) return 0;
+        update_stat_mem_access(sim, p->nstat_counts, p->access->op, p->access->enclave_mode);
+        if(!access_levels(sim, p, 0, 1, 0, 0)) return 0;
+    }
+
+    search_cache(PLACE_LINE, sim, p, l, &free);
+    *l1_cold = (free != -1);
+    return 1;
+}
 
+// strict mode: continues an access that missed in the first level cache, in the order of access_cache()
+void access_other_levels(sim_t* sim, process_t* p, char warm, char l1_cold) {
+    if(warm) warm_levels(sim, p, 1);
+    else access_levels(sim, p, 1, p->core->levels_n, 1, l1_cold);
 }
@@ -62,14 +62,59 @@ typedef struct process_t process_t;
 typedef struct core_t core_t;
 typedef struct cache_t cache_t;
 typedef struct cache_config_t cache_config_t;
-
-typedef struct cacheline_t {
-	char valid;
-	int eid;
-	uint64_t tag;
-    int enclave_mode; // enclave line or not ; need to know when evicting
-    char dirty; // if a dirty enclave line gets evicted, an encryption overhead occurs
-} cacheline_t;
+typedef struct cache_lines_t cache_lines_t;
+typedef struct level_t level_t;
+
+// access path of a cache ; bound once per config by bind_access_path(), for non-enclave [0] and enclave [1] accesses
+typedef int (*index_fn_t)(sim_t* sim, process_t* p, cache_t* c, int cache_type, cache_config_t* config, uint64_t addr, uint64_t* tag); // returns the set, sets the tag
+typedef int (*lookup_fn_t)(sim_t* sim, process_t* p, cache_config_t* config, cache_lines_t* lines, int set_idx, int* free, int eid, int enclave_mode, uint64_t tag); // see search_set()
+typedef int (*victim_fn_t)(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode); // see pick_victim_way()
+
+#define HOST_LINE_SIZE 64 // bytes ; cache content is laid out in lines of the machine running the simulation
+
+/* line metadata ; one uint16_t per line, the eid of the line's process above the flags */
+#define LINE_VALID 0x1
+#define LINE_DIRTY 0x2 // if a dirty enclave line gets evicted, an encryption overhead occurs
+#define LINE_ENCLAVE 0x4 // enclave line or not ; need to know when evicting
+#define LINE_EID_SHIFT 3
+#define LINE_EIDS_N (1 << (16 - LINE_EID_SHIFT)) // number of processes the metadata can tell apart
+
+// content of one cache ; every set is in one array, with the ways of a set next to each other
+typedef struct cache_lines_t {
+    int ways_n;
+    uint64_t* tags; // tags[set_idx * ways_n + way]
+    uint16_t* meta; // same index as tags
+    uint64_t* plru; // binary search tree of each set for eviction, as bits (see touch_plru)
+    int plru_levels; // log2(ways_n)
+    uint16_t* sharers; // directory (see init_directory) ; dir_bit of the private caches that may hold a copy of the line ; NULL otherwise
+} cache_lines_t;
+
+#define DIR_SHARERS_MAX 16 // private caches (configs) a directory tells apart
+#define DIR_ALL 0xffff
+
+#define PLRU_LEVELS_MAX 6 // a set's PLRU tree fits in one uint64_t up to 64 ways
+
+typedef struct plru_path_t {
+    uint64_t mask; // nodes from the root to a way
+    uint64_t bits; // their bits after the way is accessed
+} plru_path_t;
+
+static inline size_t line_idx(cache_lines_t* lines, int set_idx, int way) {
+    return (size_t) set_idx * lines->ways_n + way;
+}
+
+static inline uint64_t* get_plru(cache_lines_t* lines, int set_idx) {
+    return &lines->plru[set_idx];
+}
+
+static inline uint16_t line_meta(int eid, int enclave_mode, char dirty) {
+    return (uint16_t) ((eid << LINE_EID_SHIFT) | LINE_VALID | (enclave_mode ? LINE_ENCLAVE : 0) | (dirty ? LINE_DIRTY : 0));
+}
+
+static inline char line_valid(uint16_t meta) { return meta & LINE_VALID; }
+static inline char line_dirty(uint16_t meta) { return (meta & LINE_DIRTY) != 0; }
+static inline int line_enclave_mode(uint16_t meta) { return (meta & LINE_ENCLAVE) != 0; }
+static inline int line_eid(uint16_t meta) { return meta >> LINE_EID_SHIFT; }
 
 typedef struct sat_entry_t {
 	char valid;
@@ -79,7 +124,9 @@ typedef struct sat_entry_t {
 // information about enclave way
 typedef struct enclave_way_info_t {
 	char valid;
-	int set_bits_n;
+	int set_bits_n; // set with set_eway_bits()
+    uint64_t set_mask; // set and tag masks of this way's partitions ; from set_bits_n
+    uint64_t tag_mask;
 	int alloc_n; // number of partitions allocated to enclaves 
 	sat_entry_t* sat;	
 	char* sat_plru;	
@@ -128,6 +175,24 @@ typedef struct cache_config_t {
 	int enclave_ways_n; // current rumber of ways allocated to enclaves ; changes over time
 	enclave_way_info_t* eway_info;
 
+    /* addressing of partitions and cachelets ; computed by init_addressing() */
+    int partition_bits_n; // log2(max_partition)
+    uint64_t way_bitmap_mask; // set index bits that pick a way bitmap (see get_way_bitmap_idx)
+    int way_bitmap_shift;
+    uint64_t* cachelet_set_masks; // dynamic cachelets ; set and tag masks of 2^i cachelets
+    uint64_t* cachelet_tag_masks;
+
+    /* access path ; indexed by enclave mode */
+    index_fn_t index[2];
+    lookup_fn_t lookup[2];
+    victim_fn_t victim[2];
+    char uses_plru; // hits and fills update the PLRU bits
+    char fast_hit[2]; // a first level hit can take l1_hit() ; the index has no side effects and there are no dynamic cachelet checks
+
+    /* directory (see init_directory) */
+    uint16_t dir_bit; // private cache ; its bit in the sharers of a line ; 0 if there is no directory
+    char dir_tracked[2]; // shared cache ; lines of this enclave mode keep their sharers
+
 } cache_config_t;
 
 typedef struct cache_t {
@@ -135,23 +200,39 @@ typedef struct cache_t {
 	char unified;
 
 	cache_config_t* config[3];	
-	cacheline_t** cache[3]; // actual cache content ; index using cache type (insn, data, unified)
-	char** plru[3]; // binary search tree for eviction	
+	cache_lines_t lines[3]; // actual cache content ; index using cache type (insn, data, unified)
     nstat_count_t* nstat_counts[3];
+    uint64_t warm_accesses[3]; // adaptive warmup ; accesses and misses of the current window (see check_warmup)
+    uint64_t warm_misses[3];
 
 	cache_t* next; // next level of cache
 			
 } cache_t;
 
+// one level of a core's caches as an access sees it ; core->levels has the private levels, then the shared ones
+typedef struct level_t {
+    cache_t* cache;
+    int type[3]; // cache type (insn, data, unified) of each op (load, store, insn)
+    char llc; // last level cache
+    char fast; // first level private cache that is not the last level ; its hits may take l1_hit()
+} level_t;
+
 void init_cache(sim_t* sim);
 
 int pick_victim_way(sim_t* sim, process_t* p, cache_t* c, cache_config_t* config, int cache_type, int set_idx, int enclave_mode);
-void update_plru(char* plru, int slots_n, int slot_accessed);
+void update_plru(char* plru, int levels, int slot_accessed);
+void touch_plru(cache_lines_t* lines, int set_idx, int way);
 
 int evict_sgx_plru(cache_t* c, cache_config_t* config, int cache_type, int set_idx);
-void set_line(process_t* p, cacheline_t* cl, uint64_t tag);
+void set_eway_bits(cache_config_t* config, enclave_way_info_t* eway, int set_bits_n);
+void set_line(process_t* p, cache_lines_t* lines, int set_idx, int way, uint64_t tag);
 
 void free_partition(sim_t* sim, process_t* p, char process_finished);
 void access_cache(sim_t* sim, process_t* p);
+void warm_cache(sim_t* sim, process_t* p);
+char access_private(sim_t* sim, process_t* p, char* l1_cold);
+void access_shared(sim_t* sim, process_t* p, char l1_cold);
+char access_first_level(sim_t* sim, process_t* p, char warm, char* l1_cold);
+void access_other_levels(sim_t* sim, process_t* p, char warm, char l1_cold);
 
 #endif /* CACHE_H */
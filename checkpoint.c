@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "cache.h"
+#include "trace.h"
+#include "utils.h"
+
+static void write_block(FILE* f, const void* data, size_t size) {
+    if(size > 0 && fwrite(data, size, 1, f) != 1) error("Failed to write checkpoint");
+}
+
+static void read_block(FILE* f, void* data, size_t size) {
+    if(size > 0 && fread(data, size, 1, f) != 1) error("Checkpoint is truncated");
+}
+
+// a checkpoint only fits a sim with the same caches
+static void check(char ok, char* file, char* what) {
+    if(ok) return;
+    printf("Checkpoint %s does not match this simulation (%s)\n", file, what);
+    exit(1);
+}
+
+// every cache level ; private levels of each core, then the shared levels
+static void save_cache(FILE* f, cache_t* c) {
+    for(int t=0; t<3; t++) {
+        cache_config_t* config = c->config[t];
+        if(!config) continue;
+        cache_lines_t* lines = &c->lines[t];
+        size_t lines_n = (size_t) config->sets_n * config->ways_n;
+        write_block(f, lines->tags, lines_n * sizeof(uint64_t));
+        write_block(f, lines->meta, lines_n * sizeof(uint16_t));
+        write_block(f, lines->plru, (size_t) config->sets_n * sizeof(uint64_t));
+        if(lines->sharers) write_block(f, lines->sharers, lines_n * sizeof(uint16_t));
+        write_block(f, c->nstat_counts[t], NUM_EVENTS * sizeof(nstat_count_t));
+    }
+}
+
+static void load_cache(FILE* f, cache_t* c) {
+    for(int t=0; t<3; t++) {
+        cache_config_t* config = c->config[t];
+        if(!config) continue;
+        cache_lines_t* lines = &c->lines[t];
+        size_t lines_n = (size_t) config->sets_n * config->ways_n;
+        read_block(f, lines->tags, lines_n * sizeof(uint64_t));
+        read_block(f, lines->meta, lines_n * sizeof(uint16_t));
+        read_block(f, lines->plru, (size_t) config->sets_n * sizeof(uint64_t));
+        if(lines->sharers) read_block(f, lines->sharers, lines_n * sizeof(uint16_t));
+        read_block(f, c->nstat_counts[t], NUM_EVENTS * sizeof(nstat_count_t));
+    }
+}
+
+// whether the shared cache of this config keeps a directory (see init_directory)
+static char has_sharers(sim_t* sim, cache_config_t* config) {
+    for(cache_t* c = sim->cache; c; c = c->next) {
+        for(int t=0; t<3; t++) {
+            if(c->config[t] == config) return c->lines[t].sharers != NULL;
+        }
+    }
+    return 0;
+}
+
+#define LAYOUT_N 13
+
+// everything that decides the size of the blocks of a config and its caches ; checked before any of them is read
+static void get_layout(sim_t* sim, cache_config_t* c, int32_t* layout) {
+    int32_t l[LAYOUT_N] = {
+        c->type, c->level, c->sets_n, c->ways_n, c->line_size, c->inclu_policy,
+        c->set_partition, c->use_cachelet, c->max_partition, c->max_enclave_ways_n,
+        c->eway_info != NULL, c->way_bitmaps != NULL, has_sharers(sim, c)
+    };
+    memcpy(layout, l, sizeof(l));
+}
+
+static void save_configs(FILE* f, sim_t* sim) {
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        int32_t layout[LAYOUT_N];
+        get_layout(sim, c, layout);
+        write_block(f, layout, sizeof(layout));
+        write_block(f, &c->enclave_ways_n, sizeof(int));
+        if(c->eway_info) {
+            for(int w=0; w<c->max_enclave_ways_n; w++) {
+                enclave_way_info_t* eway = &c->eway_info[w];
+                write_block(f, &eway->valid, sizeof(char));
+                write_block(f, &eway->set_bits_n, sizeof(int));
+                write_block(f, &eway->alloc_n, sizeof(int));
+                write_block(f, eway->sat, c->max_partition * sizeof(sat_entry_t));
+                write_block(f, eway->sat_plru, c->max_partition - 1);
+            }
+        }
+        if(c->way_bitmaps) write_block(f, c->way_bitmaps, c->max_partition * sizeof(uint64_t));
+    }
+}
+
+static void load_configs(FILE* f, sim_t* sim, char* file) {
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        int32_t saved[LAYOUT_N], layout[LAYOUT_N];
+        read_block(f, saved, sizeof(saved));
+        get_layout(sim, c, layout);
+        check(memcmp(saved, layout, sizeof(layout)) == 0, file, c->name); // geometry, partitioning or directory differ
+        read_block(f, &c->enclave_ways_n, sizeof(int));
+        if(c->eway_info) {
+            for(int w=0; w<c->max_enclave_ways_n; w++) {
+                enclave_way_info_t* eway = &c->eway_info[w];
+                read_block(f, &eway->valid, sizeof(char));
+                read_block(f, &eway->set_bits_n, sizeof(int));
+                set_eway_bits(c, eway, eway->set_bits_n);
+                read_block(f, &eway->alloc_n, sizeof(int));
+                read_block(f, eway->sat, c->max_partition * sizeof(sat_entry_t));
+                read_block(f, eway->sat_plru, c->max_partition - 1);
+            }
+        }
+        if(c->way_bitmaps) read_block(f, c->way_bitmaps, c->max_partition * sizeof(uint64_t));
+    }
+}
+
+// trace state of p comes from sched_p, the process that reads the trace
+static void save_process(FILE* f, process_t* p, process_t* sched_p) {
+    write_block(f, &p->valid, sizeof(char));
+    if(!p->valid) return;
+    long int cursor = sched_p->cursor - sched_p->tracefile->map;
+    write_block(f, &p->eid, sizeof(int));
+    write_block(f, &sched_p->done, sizeof(char));
+    write_block(f, &cursor, sizeof(long int));
+    write_block(f, &sched_p->stream, sizeof(trace_stream_t));
+    write_block(f, &sched_p->trace_offset, sizeof(long int));
+    write_block(f, &sched_p->records_read, sizeof(uint64_t));
+    write_block(f, &p->sat_idx, sizeof(int));
+    write_block(f, &p->eway_idx, sizeof(int));
+    write_block(f, &p->partition_factor, sizeof(int));
+    write_block(f, &p->miss_counter, sizeof(uint64_t));
+    write_block(f, &p->num_cachelets, sizeof(int));
+    write_block(f, p->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+}
+
+static void load_process(FILE* f, process_t* p, char* file) {
+    char valid;
+    read_block(f, &valid, sizeof(char));
+    check(valid == p->valid, file, "processes");
+    if(!p->valid) return;
+    int eid;
+    long int cursor;
+    read_block(f, &eid, sizeof(int));
+    check(eid == p->eid, file, "processes");
+    read_block(f, &p->done, sizeof(char));
+    read_block(f, &cursor, sizeof(long int));
+    read_block(f, &p->stream, sizeof(trace_stream_t));
+    read_block(f, &p->trace_offset, sizeof(long int));
+    read_block(f, &p->records_read, sizeof(uint64_t));
+    read_block(f, &p->sat_idx, sizeof(int));
+    read_block(f, &p->eway_idx, sizeof(int));
+    read_block(f, &p->partition_factor, sizeof(int));
+    read_block(f, &p->miss_counter, sizeof(uint64_t));
+    read_block(f, &p->num_cachelets, sizeof(int));
+    read_block(f, p->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+    check(cursor >= 0 && (size_t) cursor <= p->tracefile->size, file, p->tracefile->filename);
+    p->cursor = p->tracefile->map + cursor;
+}
+
+// writes sim's caches ; the trace cursors, cores and pending accesses are those of sched, the sim reading the traces
+void save_checkpoint(sim_t* sim, sim_t* sched, int num_done) {
+
+    FILE* f = fopen(sim->checkpoint_save, "wb");
+    if(!f) {
+        printf("Failed to open %s\n", sim->checkpoint_save);
+        exit(1);
+    }
+
+    checkpoint_header_t h;
+    memset(&h, 0, sizeof(checkpoint_header_t));
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.config_n = sim->config_n;
+    h.cores_n = sim->cores_n;
+    h.prog_n = sim->prog_n;
+    h.progs_per_core = sim->progs_per_core;
+    h.tracefiles_n = sim->tracefiles_n;
+    h.trace_n = sim->trace_n;
+    h.num_done = num_done;
+    h.heap_n = sched->heap_n;
+    write_block(f, &h, sizeof(checkpoint_header_t));
+
+    write_block(f, &sim->next_eid, sizeof(int));
+    write_block(f, &sim->rng, sizeof(uint64_t));
+    write_block(f, &sim->tracefile_ptr, sizeof(int));
+    for(int i=0; i<sim->tracefiles_n; i++) {
+        tracefile_t* t = &sim->tracefiles[i];
+        write_block(f, t->filename, sizeof(t->filename));
+        write_block(f, &t->threads_launched, sizeof(int));
+        write_block(f, &t->threads_completed, sizeof(int));
+    }
+    save_configs(f, sim);
+
+    for(int i=0; i<sim->cores_n; i++) {
+        for(cache_t* c = sim->cores[i].cache; c && c != sim->cache; c = c->next) save_cache(f, c);
+    }
+    for(cache_t* c = sim->cache; c; c = c->next) save_cache(f, c);
+
+    for(int i=0; i<sim->cores_n; i++) {
+        core_t* core = &sim->cores[i];
+        core_t* sched_core = &sched->cores[i];
+        write_block(f, &sched_core->clock, sizeof(double));
+        write_block(f, &sched_core->current_process, sizeof(int));
+        write_block(f, core->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+        for(int j=0; j<sim->progs_per_core; j++) save_process(f, &core->processes[j], &sched_core->processes[j]);
+    }
+    write_block(f, sim->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+
+    write_block(f, sched->queue, sim->cores_n * sizeof(access_t));
+    write_block(f, sched->heap, sched->heap_n * sizeof(int));
+
+    if(fclose(f) != 0) printf("Failed to close %s\n", sim->checkpoint_save);
+    else printf("Checkpoint after %lu accesses written to %s\n", sim->trace_n, sim->checkpoint_save);
+}
+
+// restores a checkpoint into a sim made by init_sim() from the same config and .prog files ; returns 0 if there is no checkpoint to load
+int load_checkpoint(sim_t* sim, int* num_done) {
+
+    char* file = sim->checkpoint_load;
+    if(!file) return 0;
+    FILE* f = fopen(file, "rb");
+    if(!f) {
+        printf("Failed to open checkpoint %s\n", file);
+        exit(1);
+    }
+
+    checkpoint_header_t h;
+    read_block(f, &h, sizeof(checkpoint_header_t));
+    check(memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) == 0 && h.version == CHECKPOINT_VERSION, file, "not a checkpoint of this version");
+    check(h.config_n == sim->config_n, file, "number of caches");
+    check(h.cores_n == sim->cores_n && h.prog_n == sim->prog_n && h.progs_per_core == sim->progs_per_core, file, "cores and processes");
+    check(h.tracefiles_n == sim->tracefiles_n, file, "trace files");
+    check(h.heap_n >= 0 && h.heap_n <= sim->cores_n, file, "cores");
+    sim->trace_n = h.trace_n;
+    sim->start_stat = sim->trace_n; // the warmup is done
+    sim->max_traces = sim->start_stat + sim->stat_traces;
+    *num_done = h.num_done;
+    sim->heap_n = h.heap_n;
+
+    read_block(f, &sim->next_eid, sizeof(int));
+    read_block(f, &sim->rng, sizeof(uint64_t));
+    read_block(f, &sim->tracefile_ptr, sizeof(int));
+    for(int i=0; i<sim->tracefiles_n; i++) {
+        tracefile_t* t = &sim->tracefiles[i];
+        char filename[sizeof(t->filename)];
+        read_block(f, filename, sizeof(filename));
+        check(strcmp(filename, t->filename) == 0, file, t->filename);
+        read_block(f, &t->threads_launched, sizeof(int));
+        read_block(f, &t->threads_completed, sizeof(int));
+    }
+    load_configs(f, sim, file);
+
+    for(int i=0; i<sim->cores_n; i++) {
+        for(cache_t* c = sim->cores[i].cache; c && c != sim->cache; c = c->next) load_cache(f, c);
+    }
+    for(cache_t* c = sim->cache; c; c = c->next) load_cache(f, c);
+
+    for(int i=0; i<sim->cores_n; i++) {
+        core_t* core = &sim->cores[i];
+        read_block(f, &core->clock, sizeof(double));
+        read_block(f, &core->current_process, sizeof(int));
+        read_block(f, core->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+        for(int j=0; j<sim->progs_per_core; j++) load_process(f, &core->processes[j], file);
+    }
+    read_block(f, sim->nstat_counts, NUM_EVENTS * sizeof(nstat_count_t));
+
+    read_block(f, sim->queue, sim->cores_n * sizeof(access_t));
+    read_block(f, sim->heap, sim->heap_n * sizeof(int));
+    fclose(f);
+
+    printf("Restored the checkpoint %s ; starting at access %lu\n", file, sim->trace_n);
+    return 1;
+}
@@ -0,0 +1,42 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "sim.h"
+
+/*
+    Checkpoints of the warmed up simulation ; SYSTEM checkpoint_save: <file> and checkpoint_load: <file>
+
+    With checkpoint_save:, the state of the simulation after start_stat accesses (the warmup) is written to <file>: the content
+    and PLRU bits of every cache, enclave way/SAT state and way bitmaps, every process (trace cursor, partition
+    state, counts), the cores and the pending access of every core. A run with checkpoint_load: <file> restores
+    it and starts collecting statistics right away. The config must have the same caches and the .prog file the
+    same traces ; parameters that only matter to statistics can change. In a sweep, the scheduling state (trace
+    cursors and pending accesses) comes from the first config's checkpoint.
+    Not saved: decoder threads read ahead of the trace cursors (checkpoint_save: needs decoders_n: 0), and the
+    miss-ratio curve stacks (see mrc.h) start empty.
+*/
+
+#define CHECKPOINT_MAGIC "SGXCCKP"
+#define CHECKPOINT_VERSION 6 // 2: cache content as tag and metadata arrays ; 3: PLRU bits in one word per set ; 4: directory ; 5: random state ; 6: layout of every config
+
+typedef struct checkpoint_header_t {
+    char magic[8];
+    uint32_t version;
+    int32_t config_n;
+    int32_t cores_n;
+    int32_t prog_n;
+    int32_t progs_per_core;
+    int32_t tracefiles_n;
+    uint64_t trace_n;
+    int32_t num_done;
+    int32_t heap_n;
+} checkpoint_header_t;
+
+void save_checkpoint(sim_t* sim, sim_t* sched, int num_done);
+int load_checkpoint(sim_t* sim, int* num_done);
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> // basename()
+#include <math.h>
+
+#define __STDC_FORMAT_MACROS // for printing int64_t
+#include <inttypes.h>
+
+#include "trace_format.h"
+
+/*
+    sgxc-convert: turns a text trace into a binary or compressed trace (see trace_format.h)
+*/
+
+#define MAX_ENCODED_RECORD 20 // bytes ; a run header (2 varints) and an access (1 varint)
+
+typedef struct block_writer_t {
+    FILE* out;
+    trace_record_t records[TRACE_BLOCK_RECORDS_N]; // accesses of the block being built
+    int records_n;
+    uint8_t payload[TRACE_BLOCK_RECORDS_N * MAX_ENCODED_RECORD];
+
+    uint64_t* index; // file offset of every block written
+    uint64_t blocks_n;
+    uint64_t index_size;
+} block_writer_t;
+
+// encodes the buffered accesses as one block of a compressed trace
+void write_block(block_writer_t* w) {
+
+    if(w->records_n == 0) return;
+
+    uint64_t prev_addr[3] = {0, 0, 0}; // per op ; reset in every block
+    uint32_t size = 0;
+    int i = 0;
+    while(i < w->records_n) {
+        // a run of accesses with the same interval and enclave mode
+        trace_record_t* first = &w->records[i];
+        int run_n = 1;
+        while(i + run_n < w->records_n &&
+              w->records[i + run_n].interval == first->interval &&
+              w->records[i + run_n].enclave_mode == first->enclave_mode) run_n++;
+
+        size += varint_encode(&w->payload[size], ((uint64_t) run_n << 1) | (first->enclave_mode & 1));
+        size += varint_encode(&w->payload[size], first->interval);
+        for(int j=i; j<i+run_n; j++) {
+            trace_record_t* r = &w->records[j];
+            int64_t delta = (int64_t) (r->addr - prev_addr[r->op]);
+            prev_addr[r->op] = r->addr;
+            if(zigzag_encode(delta) >> 62) { // the op takes the lowest 2 bits
+                printf("Address delta %" PRId64 " is too large to encode\n", delta);
+                exit(1);
+            }
+            size += varint_encode(&w->payload[size], (zigzag_encode(delta) << 2) | r->op);
+        }
+        i += run_n;
+    }
+
+    if(w->blocks_n == w->index_size) {
+        w->index_size = (w->index_size) ? w->index_size * 2 : 1024;
+        w->index = realloc(w->index, w->index_size * sizeof(uint64_t));
+    }
+    w->index[w->blocks_n++] = ftell(w->out);
+
+    trace_block_t block;
+    block.record_n = w->records_n;
+    block.size = size;
+    fwrite(&block, sizeof(trace_block_t), 1, w->out);
+    fwrite(w->payload, 1, size, w->out);
+    w->records_n = 0;
+}
+
+int main(int argc, char* argv[]) {
+
+    int format = TRACE_FMT_BINARY;
+    int arg = 1;
+    if(argc > 1 && strcmp(argv[1], "-z") == 0) {
+        format = TRACE_FMT_COMPRESSED;
+        arg++;
+    }
+
+    if(argc - arg < 2) {
+        printf("./sgxc-convert [-z] <text trace> <output trace>\n");
+        printf("  -z  write a compressed trace instead of fixed-size binary records\n");
+        return 1;
+    }
+    char* in_file = argv[arg];
+    char* out_file = argv[arg + 1];
+
+    FILE* in = fopen(in_file, "r");
+    if(!in) {
+        printf("Failed to open %s\n", in_file);
+        return 1;
+    }
+    FILE* out = fopen(out_file, "w");
+    if(!out) {
+        printf("Failed to open %s\n", out_file);
+        return 1;
+    }
+
+    trace_header_t header;
+    memset(&header, 0, sizeof(trace_header_t));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.format = format;
+    header.header_size = sizeof(trace_header_t);
+    header.record_size = sizeof(trace_record_t);
+    if(format == TRACE_FMT_COMPRESSED) header.block_records_n = TRACE_BLOCK_RECORDS_N;
+    char* in_path = strdup(in_file);
+    snprintf(header.source, sizeof(header.source), "sgxc-convert %s", basename(in_path));
+    free(in_path);
+
+    // header is rewritten with the record count at the end
+    fwrite(&header, sizeof(trace_header_t), 1, out);
+
+    block_writer_t* w = NULL;
+    if(format == TRACE_FMT_COMPRESSED) {
+        w = (block_writer_t*) malloc(sizeof(block_writer_t));
+        memset(w, 0, sizeof(block_writer_t));
+        w->out = out;
+    }
+
+    char* line = NULL;
+    size_t size = 0;
+    uint64_t skipped = 0;
+    uint64_t line_n = 0;
+    uint64_t inexact = 0; // intervals with more precision than TRACE_INTERVAL_SCALE
+    while(getline(&line, &size, in) > 0) {
+        line_n++;
+        double interval;
+        int enclave_mode;
+        void* addr;
+        int op;
+        if(sscanf(line, "%lf %i %p %i", &interval, &enclave_mode, &addr, &op) != 4) {
+            skipped++; // ex. the "<n>#eof" line written by the pintool
+            continue;
+        }
+
+        // the record holds an unsigned 32-bit count of 1/TRACE_INTERVAL_SCALE ; a cast would wrap the others silently
+        if(!(interval >= 0) || interval * TRACE_INTERVAL_SCALE >= UINT32_MAX + 0.5) {
+            printf("Line %lu: interval %f is out of range, it must be in [0, %.6f]\n", line_n, interval, UINT32_MAX / TRACE_INTERVAL_SCALE);
+            free(line);
+            if(w) free(w->index);
+            free(w);
+            fclose(in);
+            fclose(out);
+            remove(out_file);
+            return 1;
+        }
+
+        trace_record_t r;
+        memset(&r, 0, sizeof(trace_record_t));
+        r.addr = (uint64_t) addr;
+        r.interval = (uint32_t) llround(interval * TRACE_INTERVAL_SCALE);
+        if(r.interval / TRACE_INTERVAL_SCALE != interval) inexact++;
+        r.enclave_mode = enclave_mode;
+        r.op = op;
+        header.record_n++;
+
+        if(w) {
+            w->records[w->records_n++] = r;
+            if(w->records_n == TRACE_BLOCK_RECORDS_N) write_block(w);
+        } else fwrite(&r, sizeof(trace_record_t), 1, out);
+    }
+    free(line);
+    fclose(in);
+
+    if(w) {
+        write_block(w);
+        header.index_offset = ftell(out);
+        fwrite(w->index, sizeof(uint64_t), w->blocks_n, out);
+        free(w->index);
+        free(w);
+    }
+
+    long int out_size = ftell(out);
+    rewind(out);
+    fwrite(&header, sizeof(trace_header_t), 1, out);
+    if(fclose(out) != 0) {
+        printf("Failed to close %s\n", out_file);
+        return 1;
+    }
+
+    printf("Wrote %lu records to %s (%.2f bytes per record)", header.record_n, out_file, (double) out_size / (header.record_n ? header.record_n : 1));
+    if(skipped) printf(" (skipped %lu lines)", skipped);
+    printf("\n");
+    if(inexact) printf("Warning: %lu intervals were rounded to 1/%.0f\n", inexact, TRACE_INTERVAL_SCALE);
+
+    return 0;
+}
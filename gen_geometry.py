@@ -0,0 +1,61 @@
+# must run with Python 3.5 or newer
+# writes the cache geometry of a .config as compile-time constants for sgxc-fixed (make fixed CONFIG=<.config>)
+# usage: python3 gen_geometry.py <.config> > geometry.h
+import sys
+import math
+
+if len(sys.argv) != 2:
+    print('usage: python3 gen_geometry.py <.config>', file=sys.stderr)
+    sys.exit(1)
+config_file = sys.argv[1]
+
+caches = [] # in the order of the config file, as the config ids in sim.c
+cache = None
+with open(config_file) as f:
+    for line in f:
+        line = line.strip()
+        if line == 'CACHE':
+            cache = {'name': '', 'size_kb': 0, 'size_b': 0, 'line_size': 0, 'ways_n': 0}
+            caches.append(cache)
+            continue
+        if line == 'SYSTEM':
+            cache = None
+            continue
+        tokens = line.split()
+        if cache is None or len(tokens) < 2:
+            continue
+        param = tokens[0].rstrip(':')
+        if param == 'name':
+            cache['name'] = tokens[1]
+        elif param in ('size_kb', 'size_b', 'line_size', 'ways_n'):
+            cache[param] = int(tokens[1])
+
+if len(caches) == 0:
+    print('%s has no caches' % config_file, file=sys.stderr)
+    sys.exit(1)
+
+print('// generated by gen_geometry.py from %s ; do not edit' % config_file)
+print('#ifndef GEOMETRY_H')
+print('#define GEOMETRY_H')
+print('')
+print('#define FIXED_CONFIG_FILE "%s"' % config_file)
+print('#define FIXED_CONFIGS_N %i' % len(caches))
+print('')
+print('// ADD_GEOMETRY(id, sets_n, ways_n, offset_bits_n, set_bits_n) of every cache ; see init_cache() for how they are computed')
+print('#define FIXED_CACHES(ADD_GEOMETRY) \\')
+for i, c in enumerate(caches):
+    if c['ways_n'] <= 0 or c['line_size'] <= 0:
+        print('%s: ways_n and line_size must be set' % c['name'], file=sys.stderr)
+        sys.exit(1)
+    sets_n = (c['size_kb'] * 1024) // (c['ways_n'] * c['line_size'])
+    if sets_n == 0 and c['size_b'] > 0:
+        sets_n = c['size_b'] // (c['ways_n'] * c['line_size'])
+    if sets_n == 0:
+        print('%s: no sets' % c['name'], file=sys.stderr)
+        sys.exit(1)
+    offset_bits_n = int(math.log2(c['line_size']))
+    set_bits_n = int(math.log2(sets_n))
+    end = ' \\' if i < len(caches) - 1 else ''
+    print('    ADD_GEOMETRY(%i, %i, %i, %i, %i) /* %s */%s' % (i, sets_n, c['ways_n'], offset_bits_n, set_bits_n, c['name'], end))
+print('')
+print('#endif /* GEOMETRY_H */')
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mrc.h"
+#include "utils.h"
+
+static const char* stream_names[MRC_STREAMS_N] = {"ne", "e", "all"};
+
+static uint32_t next_prio(uint32_t* seed) { // xorshift
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static uint64_t hash_line(uint64_t line) {
+    return line * 0x9E3779B97F4A7C15ull;
+}
+
+// slot a line hashes to ; the high bits of the product depend on every bit of the line, the low bits of a strided line are 0
+static inline uint64_t table_home(mrc_stack_t* s, uint64_t line, uint32_t owner) {
+    return hash_line(line ^ ((uint64_t) owner << 40)) >> s->table_shift;
+}
+
+// eid and enclave mode of a line ; the same address in another process or mode is another line
+static inline uint32_t line_owner(int eid, int enclave_mode) {
+    return ((uint32_t) eid << 1) | (enclave_mode != 0);
+}
+
+/*
+    treap ; every node of a set's treap has a different time
+*/
+
+static int node_size(mrc_stack_t* s, int n) {
+    return (n == -1) ? 0 : s->nodes[n].size;
+}
+
+static void node_update(mrc_stack_t* s, int n) {
+    s->nodes[n].size = 1 + node_size(s, s->nodes[n].left) + node_size(s, s->nodes[n].right);
+}
+
+// l gets the nodes with time < key, r the rest
+static void split(mrc_stack_t* s, int n, uint64_t key, int* l, int* r) {
+    if(n == -1) {
+        *l = *r = -1;
+        return;
+    }
+    mrc_node_t* node = &s->nodes[n];
+    if(node->time < key) {
+        split(s, node->right, key, &node->right, r);
+        *l = n;
+    } else {
+        split(s, node->left, key, l, &node->left);
+        *r = n;
+    }
+    node_update(s, n);
+}
+
+// every node of l is older than every node of r
+static int merge(mrc_stack_t* s, int l, int r) {
+    if(l == -1) return r;
+    if(r == -1) return l;
+    if(s->nodes[l].prio > s->nodes[r].prio) {
+        s->nodes[l].right = merge(s, s->nodes[l].right, r);
+        node_update(s, l);
+        return l;
+    }
+    s->nodes[r].left = merge(s, l, s->nodes[r].left);
+    node_update(s, r);
+    return r;
+}
+
+// lines of the set used after time ; the stack distance of the line last used at time
+static int newer_than(mrc_stack_t* s, int n, uint64_t time) {
+    int count = 0;
+    while(n != -1) {
+        mrc_node_t* node = &s->nodes[n];
+        if(node->time > time) {
+            count += 1 + node_size(s, node->right);
+            n = node->left;
+        } else if(node->time < time) n = node->right;
+        else return count + node_size(s, node->right);
+    }
+    return count;
+}
+
+// removes the node with this time and returns the treap
+static int erase(mrc_stack_t* s, int root, uint64_t time) {
+    int l, m, r;
+    split(s, root, time, &l, &m);
+    split(s, m, time + 1, &m, &r);
+    return merge(s, l, r);
+}
+
+static int oldest(mrc_stack_t* s, int n) {
+    while(s->nodes[n].left != -1) n = s->nodes[n].left;
+    return n;
+}
+
+/*
+    line -> node ; open addressing with linear probing
+*/
+
+static uint64_t table_find(mrc_stack_t* s, uint64_t line, uint32_t owner) {
+    uint64_t i = table_home(s, line, owner);
+    while(s->table[i].line != 0 && (s->table[i].line != line + 1 || s->table[i].owner != owner)) i = (i + 1) & s->table_mask;
+    return i;
+}
+
+// backward shift deletion ; keeps every probe sequence unbroken
+static void table_remove(mrc_stack_t* s, uint64_t i) {
+    uint64_t j = i;
+    while(1) {
+        j = (j + 1) & s->table_mask;
+        if(s->table[j].line == 0) break;
+        uint64_t home = table_home(s, s->table[j].line - 1, s->table[j].owner);
+        if(((j - home) & s->table_mask) >= ((j - i) & s->table_mask)) { // j's entry can move back to i
+            s->table[i] = s->table[j];
+            i = j;
+        }
+    }
+    s->table[i].line = 0;
+}
+
+static void init_stack(mrc_stack_t* s, int sets_n, int lines_n, int hist_n) {
+    s->sets_n = sets_n;
+    s->roots = malloc(sets_n * sizeof(int));
+    for(int i=0; i<sets_n; i++) s->roots[i] = -1;
+
+    int nodes_n = sets_n * lines_n;
+    s->nodes = malloc(nodes_n * sizeof(mrc_node_t));
+    s->free_nodes = malloc(nodes_n * sizeof(int));
+    s->free_n = nodes_n;
+    for(int i=0; i<nodes_n; i++) s->free_nodes[i] = nodes_n - 1 - i;
+
+    uint64_t table_n = next_pow2(2 * nodes_n);
+    s->table = calloc(table_n, sizeof(mrc_entry_t));
+    s->table_mask = table_n - 1;
+    s->table_shift = 64 - __builtin_ctzll(table_n);
+    if(!s->roots || !s->nodes || !s->free_nodes || !s->table) error("Failed to allocate the miss-ratio curve stacks");
+
+    s->hist = calloc(hist_n, sizeof(uint64_t));
+}
+
+// moves the line to the top of its set's stack ; returns its stack distance, -1 if the line was not in the stack
+static int stack_touch(mrc_stack_t* s, uint64_t line, uint32_t owner, uint32_t prio, int* node) {
+
+    int* root = &s->roots[line & (s->sets_n - 1)];
+    uint64_t now = s->time++;
+    uint64_t i = table_find(s, line, owner);
+
+    int distance = -1;
+    int n;
+    if(s->table[i].line != 0) {
+        n = s->table[i].node;
+        distance = newer_than(s, *root, s->nodes[n].time);
+        *root = erase(s, *root, s->nodes[n].time);
+    } else {
+        n = s->free_nodes[--s->free_n];
+        s->nodes[n].line = line;
+        s->nodes[n].owner = owner;
+        s->table[i].line = line + 1;
+        s->table[i].owner = owner;
+        s->table[i].node = n;
+    }
+    mrc_node_t* nd = &s->nodes[n];
+    nd->time = now;
+    nd->prio = prio;
+    nd->left = nd->right = -1;
+    nd->size = 1;
+    *root = merge(s, *root, n); // now is newer than every line of the set
+    *node = n;
+    return distance;
+}
+
+// removes a line from the stack
+static void stack_drop(mrc_stack_t* s, int n) {
+    int* root = &s->roots[s->nodes[n].line & (s->sets_n - 1)];
+    *root = erase(s, *root, s->nodes[n].time);
+    table_remove(s, table_find(s, s->nodes[n].line, s->nodes[n].owner));
+    s->free_nodes[s->free_n++] = n;
+}
+
+void init_mrc(sim_t* sim) {
+
+    if(sim->mrc_ways <= 0 && sim->shards_rate <= 0) return;
+    if(!sim->cache) {
+        printf("Miss-ratio curves need a shared cache\n");
+        exit(1);
+    }
+    if(sim->shards_rate > 0) {
+        if(sim->shards_lines <= 0) sim->shards_lines = SHARDS_LINES;
+        printf("Sampled miss-ratio curves of each process at a rate of %f, at most %i lines\n", sim->shards_rate, sim->shards_lines);
+    }
+    if(sim->mrc_ways <= 0) return;
+    if(sim->mrc_sets_min <= 0) sim->mrc_sets_min = 1;
+    if(sim->mrc_sets_max < sim->mrc_sets_min) sim->mrc_sets_max = sim->mrc_sets_min;
+    if(next_pow2(sim->mrc_sets_min) != sim->mrc_sets_min || next_pow2(sim->mrc_sets_max) != sim->mrc_sets_max) {
+        printf("mrc_sets: the number of sets must be a power of 2 (%i %i)\n", sim->mrc_sets_min, sim->mrc_sets_max);
+        exit(1);
+    }
+
+    mrc_t* m = malloc(sizeof(mrc_t));
+    memset(m, 0, sizeof(mrc_t));
+    m->ways_n = sim->mrc_ways;
+    m->sets_min = sim->mrc_sets_min;
+    m->sets_max = sim->mrc_sets_max;
+    m->offset_bits_n = sim->cache->config[(sim->cache->unified) ? UNIFIED_CACHE : DATA_CACHE]->offset_bits_n;
+    m->functions_n = log2(m->sets_max / m->sets_min) + 1;
+    m->seed = 2463534242u;
+    m->stacks = malloc(MRC_STREAMS_N * m->functions_n * sizeof(mrc_stack_t));
+    memset(m->stacks, 0, MRC_STREAMS_N * m->functions_n * sizeof(mrc_stack_t));
+    for(int st=0; st<MRC_STREAMS_N; st++) {
+        for(int f=0; f<m->functions_n; f++) init_stack(&m->stacks[st * m->functions_n + f], m->sets_min << f, m->ways_n + 1, m->ways_n + 1); // a set holds one more line until its oldest line is dropped
+    }
+    sim->mrc = m;
+    printf("Miss-ratio curves of %i to %i sets, 1 to %i ways\n", m->sets_min, m->sets_max, m->ways_n);
+}
+
+static void stack_access(mrc_t* m, mrc_stack_t* s, uint64_t line, uint32_t owner, char count) {
+
+    int n;
+    int distance = stack_touch(s, line, owner, next_prio(&m->seed), &n);
+    if(distance == -1) distance = m->ways_n; // a miss in every associativity
+
+    int root = s->roots[line & (s->sets_n - 1)];
+    if(node_size(s, root) > m->ways_n) stack_drop(s, oldest(s, root)); // the oldest line misses in every associativity
+
+    if(count) {
+        s->hist[distance]++;
+        s->accesses_n++;
+    }
+}
+
+// an access that missed in every private cache
+void mrc_access(sim_t* sim, process_t* p) {
+    access_t* a = p->access;
+    char count = (sim->trace_n >= sim->start_stat); // lines are tracked during warmup too
+    if(p->shards) shards_access(sim, p->shards, a->addr, count);
+
+    mrc_t* m = sim->mrc;
+    if(!m) return;
+    uint64_t line = a->addr >> m->offset_bits_n;
+    uint32_t owner = line_owner(p->eid, a->enclave_mode);
+    int stream = (a->enclave_mode) ? MRC_STREAM_E : MRC_STREAM_NE;
+    for(int f=0; f<m->functions_n; f++) {
+        stack_access(m, &m->stacks[stream * m->functions_n + f], line, owner, count);
+        stack_access(m, &m->stacks[MRC_STREAM_ALL * m->functions_n + f], line, owner, count);
+    }
+}
+
+/*
+    SHARDS ; sampled reuse distances of one process
+*/
+
+static uint64_t sample_hash(uint64_t line) { // splitmix64 finalizer ; spreads nearby lines
+    line ^= line >> 30;
+    line *= 0xBF58476D1CE4E5B9ull;
+    line ^= line >> 27;
+    line *= 0x94D049BB133111EBull;
+    line ^= line >> 31;
+    return line >> (64 - SHARDS_HASH_BITS);
+}
+
+// sampled lines, largest sample hash first
+static void sampled_push(shards_t* sh, int n) {
+    mrc_node_t* nodes = sh->stack.nodes;
+    int i = sh->sampled_n++;
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if(sample_hash(nodes[sh->sampled[parent]].line) >= sample_hash(nodes[n].line)) break;
+        sh->sampled[i] = sh->sampled[parent];
+        i = parent;
+    }
+    sh->sampled[i] = n;
+}
+
+static int sampled_pop(shards_t* sh) {
+    mrc_node_t* nodes = sh->stack.nodes;
+    int top = sh->sampled[0];
+    int n = sh->sampled[--sh->sampled_n];
+    uint64_t h = sample_hash(nodes[n].line);
+    int i = 0;
+    while(1) {
+        int child = 2*i + 1;
+        if(child >= sh->sampled_n) break;
+        if(child + 1 < sh->sampled_n && sample_hash(nodes[sh->sampled[child+1]].line) > sample_hash(nodes[sh->sampled[child]].line)) child++;
+        if(h >= sample_hash(nodes[sh->sampled[child]].line)) break;
+        sh->sampled[i] = sh->sampled[child];
+        i = child;
+    }
+    if(sh->sampled_n > 0) sh->sampled[i] = n;
+    return top;
+}
+
+shards_t* init_shards(sim_t* sim) {
+    shards_t* sh = malloc(sizeof(shards_t));
+    memset(sh, 0, sizeof(shards_t));
+    sh->lines_max = sim->shards_lines;
+    sh->threshold = sim->shards_rate * (1ull << SHARDS_HASH_BITS);
+    if(sh->threshold < 1) sh->threshold = 1;
+    if(sh->threshold > (1ull << SHARDS_HASH_BITS)) sh->threshold = 1ull << SHARDS_HASH_BITS;
+    sh->offset_bits_n = sim->cache->config[(sim->cache->unified) ? UNIFIED_CACHE : DATA_CACHE]->offset_bits_n;
+    sh->seed = 2463534242u;
+    init_stack(&sh->stack, 1, sh->lines_max + 1, 1);
+    sh->sampled = malloc((sh->lines_max + 1) * sizeof(int));
+    return sh;
+}
+
+void shards_access(sim_t* sim, shards_t* sh, uint64_t addr, char count) {
+
+    (void) sim;
+    uint64_t line = addr >> sh->offset_bits_n;
+    double rate = (double) sh->threshold / (1ull << SHARDS_HASH_BITS);
+    if(count) sh->accesses_n++;
+    if(sample_hash(line) >= sh->threshold) return; // not sampled
+
+    int n;
+    int distance = stack_touch(&sh->stack, line, 0, next_prio(&sh->seed), &n); // one process
+    if(distance == -1) sampled_push(sh, n);
+
+    // fixed size ; the line with the largest sample hash leaves and the rate drops below its hash
+    while(sh->sampled_n > sh->lines_max) {
+        int top = sampled_pop(sh);
+        sh->threshold = sample_hash(sh->stack.nodes[top].line);
+        stack_drop(&sh->stack, top);
+    }
+
+    if(!count) return;
+    sh->stack.accesses_n++;
+    int bin = SHARDS_BINS_N - 1; // first use of the line
+    if(distance != -1) {
+        uint64_t scaled = distance / rate;
+        bin = (scaled == 0) ? 0 : 64 - __builtin_clzll(scaled); // distances of [2^(bin-1), 2^bin) lines
+        if(bin > SHARDS_BINS_N - 2) bin = SHARDS_BINS_N - 1; // larger than every reported size
+    }
+    sh->hist[bin] += 1.0 / rate;
+}
+
+// <config>.<prog>.mrc.csv ; one row per stream, number of sets and associativity
+void write_mrc(sim_t* sim) {
+
+    mrc_t* m = sim->mrc;
+    if(!m) return;
+    FILE* file = fopen(sim->mrc_file, "w");
+    if(!file) {
+        printf("Failed to open %s\n", sim->mrc_file);
+        return;
+    }
+
+    int line_size = 1 << m->offset_bits_n;
+    fprintf(file, "stream,sets_n,ways_n,size_kb,accesses,misses,miss_ratio\n");
+    for(int st=0; st<MRC_STREAMS_N; st++) {
+        for(int f=0; f<m->functions_n; f++) {
+            mrc_stack_t* s = &m->stacks[st * m->functions_n + f];
+            uint64_t hits = 0;
+            for(int w=1; w<=m->ways_n; w++) {
+                hits += s->hist[w-1]; // distance w-1 hits with w ways
+                uint64_t misses = s->accesses_n - hits;
+                fprintf(file, "%s,%i,%i,%.2f,%lu,%lu,%f\n", stream_names[st], s->sets_n, w, (double) s->sets_n * w * line_size / 1024,
+                    s->accesses_n, misses, (s->accesses_n) ? (double) misses / s->accesses_n : 0.0);
+            }
+        }
+    }
+
+    int ret = fclose(file);
+    if(ret != 0) printf("Failed to close %s\n", sim->mrc_file);
+    else printf("Miss-ratio curves written to %s\n", sim->mrc_file);
+}
+
+// <config>.<prog>.shards.csv ; one row per process and power-of-two fully-associative LRU cache size
+void write_shards(sim_t* sim) {
+
+    char any = 0;
+    for(int i=0; i<sim->cores_n; i++) {
+        for(int j=0; j<sim->cores[i].process_n; j++) if(sim->cores[i].processes[j].shards) any = 1;
+    }
+    if(!any) return;
+
+    FILE* file = fopen(sim->shards_file, "w");
+    if(!file) {
+        printf("Failed to open %s\n", sim->shards_file);
+        return;
+    }
+
+    fprintf(file, "eid,trace,size_lines,size_kb,accesses,misses,miss_ratio,sampled,rate\n");
+    for(int i=0; i<sim->cores_n; i++) {
+        core_t* core = &sim->cores[i];
+        for(int j=0; j<core->process_n; j++) {
+            process_t* p = &core->processes[j];
+            shards_t* sh = p->shards;
+            if(!sh) continue;
+
+            // the scaled sampled accesses are short of (or over) the accesses ; the difference goes to the first bin (SHARDS_adj)
+            double scaled = 0;
+            for(int b=0; b<SHARDS_BINS_N; b++) scaled += sh->hist[b];
+            double first = sh->hist[0] + (sh->accesses_n - scaled);
+            double total = sh->accesses_n;
+            int line_size = 1 << sh->offset_bits_n;
+
+            double hits = 0;
+            for(int b=0; b<SHARDS_BINS_N - 1; b++) {
+                hits += (b == 0) ? first : sh->hist[b]; // distances below 2^b lines hit
+                uint64_t lines = 1ull << b;
+                double ratio = (total > 0) ? 1.0 - hits / total : 0.0;
+                if(ratio < 0) ratio = 0;
+                if(ratio > 1) ratio = 1;
+                fprintf(file, "%i,%s,%lu,%.2f,%lu,%.0f,%f,%lu,%f\n", p->eid, p->tracefile->filename, lines, (double) lines * line_size / 1024,
+                    sh->accesses_n, ratio * sh->accesses_n, ratio, sh->stack.accesses_n, (double) sh->threshold / (1ull << SHARDS_HASH_BITS));
+            }
+        }
+    }
+
+    int ret = fclose(file);
+    if(ret != 0) printf("Failed to close %s\n", sim->shards_file);
+    else printf("Sampled miss-ratio curves written to %s\n", sim->shards_file);
+}
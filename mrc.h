@@ -0,0 +1,107 @@
+#ifndef MRC_H
+#define MRC_H
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "sim.h"
+
+/*
+    Miss-ratio curves of the shared cache from LRU stack distances (Mattson) ; SYSTEM mrc_ways: and mrc_sets:
+
+    The accesses that miss in every private cache (the ones that reach the shared cache) go through one LRU stack
+    per set of every set-index function: sets_n = mrc_sets_min, 2*mrc_sets_min, ..., mrc_sets_max, with the set
+    picked from the address bits above the shared cache's line offset (as in get_set_and_tag()). An access at
+    stack distance d (d lines of the set were used since) hits in an LRU cache of sets_n sets with more than d
+    ways, so one pass gives the misses of every cache of sets_n * ways_n lines, ways_n = 1..mrc_ways.
+    Enclave and non-enclave accesses also go through separate stacks, as if each had its own ways. As in the cache, a
+    line is the line address with the eid and enclave mode of the access ; the set only depends on the address.
+
+    Each set's stack is a treap ordered by the time of the last access of each line and holds the mrc_ways most
+    recent lines ; a hash table maps a line to its node. An access costs O(log mrc_ways) per set-index function.
+    Memory grows with 2 * mrc_sets_max * mrc_ways.
+
+    SHARDS (SYSTEM shards_rate: and shards_lines:) gives an approximate miss-ratio curve of a fully-associative
+    LRU cache for each process, in constant memory. Only lines whose spatial hash is below a threshold (a rate of
+    shards_rate of the lines) go through the process's stack, and their reuse distances are scaled by 1/rate.
+    When more than shards_lines lines are sampled, the line with the largest hash leaves and the threshold drops
+    to its hash. Sizes are reported in powers of two of lines.
+*/
+
+#define MRC_STREAM_NE 0 // non-enclave accesses
+#define MRC_STREAM_E 1 // enclave accesses
+#define MRC_STREAM_ALL 2 // every access in one stack
+#define MRC_STREAMS_N 3
+
+typedef struct mrc_node_t {
+    uint64_t line;
+    uint32_t owner; // eid and enclave mode of the line
+    uint64_t time; // of the last access ; key of the treap
+    uint32_t prio;
+    int left;
+    int right;
+    int size; // of the subtree
+} mrc_node_t;
+
+typedef struct mrc_entry_t {
+    uint64_t line; // line address + 1 ; 0 when empty
+    uint32_t owner;
+    int node;
+} mrc_entry_t;
+
+// LRU stacks of one set-index function for one stream
+typedef struct mrc_stack_t {
+    int sets_n;
+    int* roots; // treap of each set ; -1 when empty
+
+    mrc_node_t* nodes;
+    int* free_nodes;
+    int free_n;
+
+    mrc_entry_t* table; // line and owner -> node
+    uint64_t table_mask;
+    int table_shift; // 64 - log2 of the table size
+
+    uint64_t time;
+    uint64_t* hist; // hist[d] accesses at stack distance d ; hist[mrc_ways] misses in every associativity
+    uint64_t accesses_n;
+} mrc_stack_t;
+
+#define SHARDS_LINES 8192 // default shards_lines:
+#define SHARDS_HASH_BITS 24 // sample hashes are in [0, 2^24)
+#define SHARDS_BINS_N 32 // bin 0: reuse distance 0 ; bin b: distances of [2^(b-1), 2^b) lines ; last bin: first use, or beyond 2^30 lines
+
+// sampled reuse distances of one process
+typedef struct shards_t {
+    mrc_stack_t stack; // one set
+    int* sampled; // sampled lines (nodes), largest sample hash first
+    int sampled_n;
+    int lines_max;
+    uint64_t threshold; // lines with a sample hash below it are sampled
+    int offset_bits_n;
+    uint32_t seed;
+
+    uint64_t accesses_n; // every access of the process, sampled or not
+    double hist[SHARDS_BINS_N]; // sampled accesses, each weighted by 1/rate at the time
+} shards_t;
+
+typedef struct mrc_t {
+    int ways_n; // largest associativity
+    int sets_min;
+    int sets_max;
+    int offset_bits_n; // of the shared cache's lines
+    int functions_n; // set-index functions
+    mrc_stack_t* stacks; // stacks[stream * functions_n + function]
+    uint32_t seed; // treap priorities
+} mrc_t;
+
+void init_mrc(sim_t* sim);
+void mrc_access(sim_t* sim, process_t* p);
+void write_mrc(sim_t* sim);
+
+shards_t* init_shards(sim_t* sim);
+void shards_access(sim_t* sim, shards_t* sh, uint64_t addr, char count);
+void write_shards(sim_t* sim);
+
+#endif /* MRC_H */
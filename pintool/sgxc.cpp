@@ -30,11 +30,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 END_LEGAL */
 /*
  *  This file contains an ISA-portable PIN tool for tracing memory accesses.
+ *  References are written as binary records (see trace_format.h) ; each thread
+ *  fills its own buffer, which is written to the trace file in one block when full.
+ *
+ *  Tracing starts and stops on region-of-interest markers (routine names or instruction
+ *  addresses) ; code is only instrumented while the region is active. Without a start
+ *  marker, each thread skips its first -skip references. Routines named with -ecall/-ocall
+ *  switch the enclave mode of the calling thread on entry and restore the caller's mode on exit.
  */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "pin.H"
+#include "../trace_format.h"
 
 // defined in sgxc
 #define LOAD 0
@@ -44,62 +54,158 @@ END_LEGAL */
 #define NON_ENCLAVE 0
 #define ENCLAVE 1
 
-#define ENCLAVE_MODE NON_ENCLAVE
-
 #define ONE_BILLION 1000000000
 #define FIVE_MIL 500000000
 
 #define MAX_TRACES FIVE_MIL 
-#define START_AT ONE_BILLION
+
+#define BUFFER_RECORDS_N (1 << 16) // records buffered per thread (1 MB) before they are written out
+#define MAX_THREADS 1024
+#define MODE_STACK_N 64 // nesting of -ecall/-ocall routines whose caller's mode is restored on return
 
 string outfile;
 KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool", "o", "sgxc.out", "Output file of memory references");
-
-static uint64_t trace_number = 0; // when trace_number reaches START_AT, start collecting traces and increment numTraces
-static uint64_t numTraces = 0;
+KNOB<string> KnobRoiStart(KNOB_MODE_APPEND, "pintool", "roi_start", "", "Start tracing when this routine is called (or instruction address, ex. 0x401000, is executed)");
+KNOB<string> KnobRoiStop(KNOB_MODE_APPEND, "pintool", "roi_stop", "", "Stop tracing when this routine is called (or instruction address is executed)");
+KNOB<string> KnobEcall(KNOB_MODE_APPEND, "pintool", "ecall", "", "Routine that enters the enclave ; references made inside it are enclave references");
+KNOB<string> KnobOcall(KNOB_MODE_APPEND, "pintool", "ocall", "", "Routine that leaves the enclave ; references made inside it are non-enclave references");
+KNOB<UINT64> KnobSkip(KNOB_MODE_WRITEONCE, "pintool", "skip", "1000000000", "References skipped per thread before tracing, when no -roi_start is given");
+KNOB<UINT32> KnobEnclave(KNOB_MODE_WRITEONCE, "pintool", "enclave", "0", "Enclave mode of references made outside -ecall/-ocall routines");
 
 /*
-	Trace format: interval, enclave mode, mem_addr, operation
+	Trace format: interval, enclave mode, mem_addr, operation, thread id (trace_record_t)
 */
 
+typedef struct thread_buffer_t {
+    trace_record_t records[BUFFER_RECORDS_N];
+    UINT32 records_n;
+    UINT64 trace_number; // when trace_number reaches skip, this thread starts collecting traces
+    UINT8 enclave_mode; // switched by -ecall/-ocall routines
+    UINT8 mode_stack[MODE_STACK_N]; // enclave mode of the callers of the -ecall/-ocall routines being run
+    UINT32 mode_depth; // may go past MODE_STACK_N ; calls nested deeper keep their mode on return
+    THREADID tid;
+} thread_buffer_t;
+
+static REG buffer_reg; // holds each thread's thread_buffer_t*
+static thread_buffer_t* buffers[MAX_THREADS]; // so that Fini can write out every thread's buffer
+
+static PIN_LOCK trace_lock; // protects everything below
 FILE * trace;
+static trace_header_t header;
+static UINT64 numTraces = 0; // records written to the trace file
+static BOOL reached_max = FALSE;
+
+static volatile BOOL tracing = TRUE; // region of interest is active ; FALSE until a start marker is hit when one is given
+static UINT64 skip = 0;
+static ADDRINT roi_start_addr[16], roi_stop_addr[16]; // address markers
+static int roi_start_addr_n = 0, roi_stop_addr_n = 0;
+
 clock_t previous_timestamp;
 double avr_interval = 0.000832;
+static uint32_t avr_interval_ticks; // avr_interval in trace_record_t units
+
+// writes out a thread's buffer ; returns TRUE once MAX_TRACES records have been written
+static BOOL FlushBuffer(thread_buffer_t* b) {
+    PIN_GetLock(&trace_lock, b->tid + 1);
+    if(!reached_max) {
+        UINT64 n = b->records_n;
+        if(numTraces + n > MAX_TRACES) n = MAX_TRACES - numTraces;
+        fwrite(b->records, sizeof(trace_record_t), n, trace);
+        numTraces += n;
+        if(numTraces >= MAX_TRACES) reached_max = TRUE;
+    }
+    b->records_n = 0;
+    BOOL stop = reached_max;
+    PIN_ReleaseLock(&trace_lock);
+    return stop;
+}
 
 VOID stopPin() {
-    numTraces = (numTraces < MAX_TRACES) ? trace_number : numTraces;
-    
-    fprintf(trace, "%lu#eof\n", numTraces);
+    PIN_GetLock(&trace_lock, 0);
+    header.record_n = numTraces;
+    rewind(trace);
+    fwrite(&header, sizeof(trace_header_t), 1, trace);
     fclose(trace);
-	printf("sgxc: collected %lu traces.\n", numTraces);
-	exit(0);
+    PIN_ReleaseLock(&trace_lock);
+	printf("sgxc: collected %lu traces.\n", (unsigned long) numTraces);
+}
+
+static inline VOID Record(thread_buffer_t* b, ADDRINT addr, UINT8 op) {
+    if(!tracing) return; // code instrumented before the stop marker was hit
+	b->trace_number++;
+    if(b->trace_number < skip) return;
+
+    trace_record_t* r = &b->records[b->records_n++];
+    r->addr = addr;
+    r->interval = avr_interval_ticks;
+    r->tid = (uint16_t) b->tid;
+    r->op = op;
+    r->enclave_mode = b->enclave_mode;
+    if(b->records_n == BUFFER_RECORDS_N && FlushBuffer(b)) PIN_ExitApplication(0);
+}
+
+VOID RecordInsnTrace(thread_buffer_t* b, ADDRINT ip) {
+    Record(b, ip, INSN);
+}
+
+VOID RecordMemRead(thread_buffer_t* b, ADDRINT addr) {
+    Record(b, addr, LOAD);
 }
 
-VOID RecordInsnTrace(VOID* ip) {
-	trace_number++;
-    if(trace_number < START_AT) return;
+VOID RecordMemWrite(thread_buffer_t* b, ADDRINT addr) {
+    Record(b, addr, STORE);
+}
+
+// region of interest markers ; instrumentation is thrown away so that code is re-instrumented (or not) for the new state
+VOID RoiStart() {
+    if(tracing) return;
+    tracing = TRUE;
+    PIN_RemoveInstrumentation();
+}
 
-    numTraces++;
-    fprintf(trace, "%f %i %p %i\n", avr_interval, ENCLAVE_MODE, ip, INSN);
-	if(numTraces >= MAX_TRACES) stopPin();
+VOID RoiStop() {
+    if(!tracing) return;
+    tracing = FALSE;
+    PIN_RemoveInstrumentation();
 }
 
-VOID RecordMemRead(VOID * ip, VOID * addr) {
-	trace_number++;
-    if(trace_number < START_AT) return;
+// -ecall/-ocall routines ; the mode of the caller is saved on entry and restored on return, so nested calls
+// (an ecall made inside an ocall, or under -enclave 1) return to the right mode
+VOID EnterEnclaveMode(thread_buffer_t* b, UINT32 enclave_mode) {
+    if(b->mode_depth < MODE_STACK_N) b->mode_stack[b->mode_depth] = b->enclave_mode;
+    b->mode_depth++;
+    b->enclave_mode = enclave_mode;
+}
 
-    numTraces++;
-    fprintf(trace, "%f %i %p %i\n", avr_interval, ENCLAVE_MODE, addr, LOAD);
-	if(numTraces >= MAX_TRACES) stopPin();
+VOID LeaveEnclaveMode(thread_buffer_t* b) {
+    if(b->mode_depth == 0) return; // no matching entry (ex. the routine was entered before instrumentation)
+    b->mode_depth--;
+    if(b->mode_depth < MODE_STACK_N) b->enclave_mode = b->mode_stack[b->mode_depth];
 }
 
-VOID RecordMemWrite(VOID * ip, VOID * addr) {
-    trace_number++;
-    if(trace_number < START_AT) return;
+VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v)
+{
+    if(tid >= MAX_THREADS) { // the thread would run with no buffer in buffer_reg
+        PIN_ERROR("sgxc: too many threads\n");
+        PIN_ExitApplication(1);
+    }
+    thread_buffer_t* b = new thread_buffer_t;
+    b->records_n = 0;
+    b->trace_number = 0;
+    b->enclave_mode = KnobEnclave.Value();
+    b->mode_depth = 0;
+    b->tid = tid;
+    buffers[tid] = b;
+    PIN_SetContextReg(ctxt, buffer_reg, reinterpret_cast<ADDRINT>(b));
+}
 
-    numTraces++;
-    fprintf(trace, "%f %i %p %i\n", avr_interval, ENCLAVE_MODE, addr, STORE);
-	if(numTraces >= MAX_TRACES) stopPin();
+VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 code, VOID *v)
+{
+    thread_buffer_t* b = buffers[tid];
+    if(!b) return;
+    FlushBuffer(b);
+    buffers[tid] = NULL;
+    delete b;
 }
 
 // Is called for every instruction and instruments reads and writes
@@ -110,9 +216,19 @@ VOID Instruction(INS ins, VOID *v)
     //
     // On the IA-32 and Intel(R) 64 architectures conditional moves and REP 
     // prefixed instructions appear as predicated instructions in Pin.
+
+    ADDRINT addr = INS_Address(ins);
+    for(int i=0; i<roi_start_addr_n; i++) {
+        if(addr == roi_start_addr[i]) INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)RoiStart, IARG_END);
+    }
+    for(int i=0; i<roi_stop_addr_n; i++) {
+        if(addr == roi_stop_addr[i]) INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)RoiStop, IARG_END);
+    }
+    if(!tracing) return; // outside the region of interest, only markers are instrumented
     
 	INS_InsertPredicatedCall(
                 ins, IPOINT_BEFORE, (AFUNPTR)RecordInsnTrace,
+                IARG_REG_VALUE, buffer_reg,
                 IARG_INST_PTR, 
                 IARG_END);
 
@@ -125,7 +241,7 @@ VOID Instruction(INS ins, VOID *v)
         {
             INS_InsertPredicatedCall(
                 ins, IPOINT_BEFORE, (AFUNPTR)RecordMemRead,
-                IARG_INST_PTR,
+                IARG_REG_VALUE, buffer_reg,
                 IARG_MEMORYOP_EA, memOp,
                 IARG_END);
         }
@@ -136,15 +252,63 @@ VOID Instruction(INS ins, VOID *v)
         {
             INS_InsertPredicatedCall(
                 ins, IPOINT_BEFORE, (AFUNPTR)RecordMemWrite,
-                IARG_INST_PTR,
+                IARG_REG_VALUE, buffer_reg,
                 IARG_MEMORYOP_EA, memOp,
                 IARG_END);
         }
     }
 }
 
+// instruments the routines named by a knob ; non-routine values are instruction addresses (see Instruction)
+static VOID InstrumentRoutines(IMG img, KNOB<string>& knob, AFUNPTR before, AFUNPTR after, UINT32 mode)
+{
+    for(UINT32 i=0; i<knob.NumberOfValues(); i++) {
+        const string& name = knob.Value(i);
+        if(name.empty() || name.compare(0, 2, "0x") == 0) continue;
+        RTN rtn = RTN_FindByName(img, name.c_str());
+        if(!RTN_Valid(rtn)) continue;
+
+        RTN_Open(rtn);
+        if(after) { // enclave transition
+            RTN_InsertCall(rtn, IPOINT_BEFORE, before, IARG_REG_VALUE, buffer_reg, IARG_UINT32, mode, IARG_END);
+            RTN_InsertCall(rtn, IPOINT_AFTER, after, IARG_REG_VALUE, buffer_reg, IARG_END);
+        } else RTN_InsertCall(rtn, IPOINT_BEFORE, before, IARG_END);
+        RTN_Close(rtn);
+    }
+}
+
+VOID Image(IMG img, VOID *v)
+{
+    InstrumentRoutines(img, KnobRoiStart, (AFUNPTR)RoiStart, NULL, 0);
+    InstrumentRoutines(img, KnobRoiStop, (AFUNPTR)RoiStop, NULL, 0);
+    InstrumentRoutines(img, KnobEcall, (AFUNPTR)EnterEnclaveMode, (AFUNPTR)LeaveEnclaveMode, ENCLAVE);
+    InstrumentRoutines(img, KnobOcall, (AFUNPTR)EnterEnclaveMode, (AFUNPTR)LeaveEnclaveMode, NON_ENCLAVE);
+}
+
+// reads the address markers of a knob ; returns the number of markers (routine names and addresses)
+static int ParseAddrMarkers(KNOB<string>& knob, ADDRINT* addrs, int* addrs_n)
+{
+    int markers_n = 0;
+    for(UINT32 i=0; i<knob.NumberOfValues(); i++) {
+        const string& value = knob.Value(i);
+        if(value.empty()) continue;
+        markers_n++;
+        if(value.compare(0, 2, "0x") != 0) continue;
+        if(*addrs_n == 16) {
+            PIN_ERROR("sgxc: too many address markers\n");
+            continue;
+        }
+        addrs[(*addrs_n)++] = (ADDRINT) strtoull(value.c_str(), NULL, 16);
+    }
+    return markers_n;
+}
+
 VOID Fini(INT32 code, VOID *v)
 {
+    // threads that did not exit yet still hold records
+    for(int i=0; i<MAX_THREADS; i++) {
+        if(buffers[i]) FlushBuffer(buffers[i]);
+    }
     stopPin();
 }
 
@@ -165,11 +329,41 @@ INT32 Usage()
 
 int main(int argc, char *argv[])
 {
+    PIN_InitSymbols(); // for routine markers
     if (PIN_Init(argc, argv)) return Usage();
 
+    buffer_reg = PIN_ClaimToolRegister();
+    if(!REG_valid(buffer_reg)) {
+        PIN_ERROR("sgxc: cannot allocate a scratch register\n");
+        return 1;
+    }
+    PIN_InitLock(&trace_lock);
+    avr_interval_ticks = (uint32_t) (avr_interval * TRACE_INTERVAL_SCALE + 0.5);
+
+    if(ParseAddrMarkers(KnobRoiStart, roi_start_addr, &roi_start_addr_n) > 0) tracing = FALSE;
+    else skip = KnobSkip.Value();
+    ParseAddrMarkers(KnobRoiStop, roi_stop_addr, &roi_stop_addr_n);
+
     outfile = KnobOutputFile.Value();
     trace = fopen(outfile.c_str(), "w");
 
+    // header is rewritten with the record count when tracing stops
+    memset(&header, 0, sizeof(trace_header_t));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.format = TRACE_FMT_BINARY;
+    header.header_size = sizeof(trace_header_t);
+    header.record_size = sizeof(trace_record_t);
+    const char* program = "?";
+    for(int i=0; i<argc-1; i++) {
+        if(strcmp(argv[i], "--") == 0) program = argv[i+1];
+    }
+    snprintf(header.source, sizeof(header.source), "sgxc pintool %s", program);
+    fwrite(&header, sizeof(trace_header_t), 1, trace);
+
+    PIN_AddThreadStartFunction(ThreadStart, 0);
+    PIN_AddThreadFiniFunction(ThreadFini, 0);
+    IMG_AddInstrumentFunction(Image, 0);
     INS_AddInstrumentFunction(Instruction, 0);
     PIN_AddFiniFunction(Fini, 0);
 
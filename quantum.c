@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "quantum.h"
+#include "cache.h"
+#include "utils.h"
+
+static void defer_access(quantum_core_t* qc, access_t* a, char l1_cold) {
+    if(qc->deferred_n == qc->deferred_size) {
+        qc->deferred_size = (qc->deferred_size) ? qc->deferred_size * 2 : 1024;
+        qc->deferred = realloc(qc->deferred, qc->deferred_size * sizeof(access_t));
+        qc->l1_cold = realloc(qc->l1_cold, qc->deferred_size);
+    }
+    qc->l1_cold[qc->deferred_n] = l1_cold;
+    qc->deferred[qc->deferred_n++] = *a;
+}
+
+// first phase of a quantum on one core ; only touches this core's state
+static void run_private(sim_t* sim, quantum_t* q, core_t* core) {
+
+    quantum_core_t* qc = &q->cores[core->id];
+    process_t* p = &core->processes[core->current_process];
+    qc->accesses_n = 0;
+    qc->phase_end = 0;
+    qc->done_n = 0;
+
+    for(uint64_t n=0; sim->quantum_n == 0 || n < sim->quantum_n; n++) {
+        access_t* a = &sim->queue[core->id];
+        if(sim->quantum_clock > 0 && a->timestamp > q->window_end) break;
+
+        qc->accesses_n++;
+        if(a->timestamp > qc->phase_end) qc->phase_end = a->timestamp;
+        if(!(sim->ignore_ne && a->enclave_mode == 0)) {
+            p->access = a;
+            char l1_cold;
+            if(access_private(sim, p, &l1_cold)) defer_access(qc, a, l1_cold); // missed in every private cache
+            update_stat_mem_access(sim, core->nstat_counts, a->op, a->enclave_mode);
+        }
+
+        next_access(sim, core, &qc->done_n); // completed processes are counted at the end of the quantum
+    }
+}
+
+static void run_private_cores(sim_t* sim, quantum_t* q, int worker_id) {
+    for(int i=worker_id; i<sim->cores_n; i+=q->workers_n) {
+        core_t* core = &sim->cores[i];
+        if(core->current_process < 0) continue;
+        run_private(sim, q, core);
+    }
+}
+
+static void* worker_loop(void* arg) {
+
+    quantum_worker_t* w = (quantum_worker_t*) arg;
+    sim_t* sim = w->sim;
+    quantum_t* q = sim->quantum;
+
+    while(1) {
+        pthread_barrier_wait(&q->start);
+        if(!q->running) break;
+        run_private_cores(sim, q, w->id);
+        pthread_barrier_wait(&q->end);
+    }
+    return NULL;
+}
+
+// private caches that share state between cores (enclave ways, cachelets) or draw random numbers (sim->rng) must be simulated on one thread
+static int parallel_safe(sim_t* sim) {
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        if(c->shared) continue;
+        if(c->set_partition || c->use_cachelet) return 0;
+        if(c->evict_policy == EVICT_SGX_PLRU || c->evict_policy == EVICT_RAND) return 0;
+    }
+    return 1;
+}
+
+static void start_workers(sim_t* sim, quantum_t* q) {
+
+    q->workers_n = (sim->workers_n > 1) ? sim->workers_n : 1;
+    if(q->workers_n > sim->cores_n) q->workers_n = sim->cores_n;
+    if(q->workers_n > 1 && !parallel_safe(sim)) {
+        printf("Quantum mode: private caches with set partitions, cachelets or sgx_plru/random eviction are simulated on 1 thread\n");
+        q->workers_n = 1;
+    }
+    if(q->workers_n == 1) return;
+
+    printf("Quantum mode: simulating private caches on %i threads\n", q->workers_n);
+    q->running = 1;
+    pthread_barrier_init(&q->start, NULL, q->workers_n);
+    pthread_barrier_init(&q->end, NULL, q->workers_n);
+    q->workers = malloc(q->workers_n * sizeof(quantum_worker_t));
+    for(int i=1; i<q->workers_n; i++) {
+        quantum_worker_t* w = &q->workers[i];
+        w->id = i;
+        w->sim = sim;
+        if(pthread_create(&w->thread, NULL, worker_loop, w) != 0) error("Failed to create quantum worker");
+    }
+}
+
+static void stop_workers(quantum_t* q) {
+    if(q->workers_n == 1) return;
+    q->running = 0;
+    pthread_barrier_wait(&q->start); // workers see running == 0
+    for(int i=1; i<q->workers_n; i++) pthread_join(q->workers[i].thread, NULL);
+    pthread_barrier_destroy(&q->start);
+    pthread_barrier_destroy(&q->end);
+}
+
+// second phase of a quantum ; merges the deferred accesses of every core by timestamp
+static void run_shared(sim_t* sim, quantum_t* q) {
+
+    sim->heap_n = 0;
+    for(int i=0; i<sim->cores_n; i++) {
+        quantum_core_t* qc = &q->cores[i];
+        qc->next = 0;
+        if(qc->deferred_n == 0) continue;
+        q->heads[i] = qc->deferred[0];
+        heap_push(sim->heap, &sim->heap_n, q->heads, i);
+    }
+
+    while(sim->heap_n > 0) {
+        int core_id = sim->heap[0];
+        core_t* core = &sim->cores[core_id];
+        quantum_core_t* qc = &q->cores[core_id];
+        char l1_cold = qc->l1_cold[qc->next];
+        access_t* a = &qc->deferred[qc->next++];
+
+        process_t* p = &core->processes[core->current_process];
+        p->access = a;
+        access_shared(sim, p, l1_cold);
+
+        double skew = q->phase_end - a->timestamp;
+        q->skew_sum += skew;
+        if(skew > q->skew_max) q->skew_max = skew;
+
+        if(qc->next < qc->deferred_n) q->heads[core_id] = qc->deferred[qc->next];
+        else sim->heap[0] = sim->heap[--sim->heap_n]; // no more accesses from this core
+        if(sim->heap_n > 0) heap_sift_down(sim->heap, sim->heap_n, q->heads);
+    }
+
+    for(int i=0; i<sim->cores_n; i++) {
+        q->deferred_n += q->cores[i].deferred_n;
+        q->cores[i].deferred_n = 0;
+    }
+}
+
+// main simulation loop in quantum mode
+void run_quantum(sim_t* sim, int* num_done) {
+
+    quantum_t* q = malloc(sizeof(quantum_t));
+    memset(q, 0, sizeof(quantum_t));
+    q->cores = malloc(sim->cores_n * sizeof(quantum_core_t));
+    memset(q->cores, 0, sim->cores_n * sizeof(quantum_core_t));
+    q->heads = malloc(sim->cores_n * sizeof(access_t));
+    sim->quantum = q;
+    start_workers(sim, q);
+
+    double start = wall_time();
+    char stop = 0;
+    for(int i=0; i<sim->cores_n && !stop; i++) { // first access of every core
+        core_t* core = &sim->cores[i];
+        if(core->current_process < 0) continue;
+        if(!next_access(sim, core, num_done)) stop = 1;
+    }
+
+    while(!stop) {
+        if(sim->quantum_clock > 0) q->window_end += sim->quantum_clock;
+
+        sim->private_phase = 1;
+        if(q->workers_n > 1) pthread_barrier_wait(&q->start);
+        run_private_cores(sim, q, 0);
+        if(q->workers_n > 1) pthread_barrier_wait(&q->end);
+        sim->private_phase = 0;
+
+        uint64_t accesses_n = 0;
+        q->phase_end = 0;
+        for(int i=0; i<sim->cores_n; i++) {
+            quantum_core_t* qc = &q->cores[i];
+            if(sim->cores[i].current_process < 0) continue;
+            accesses_n += qc->accesses_n;
+            if(qc->phase_end > q->phase_end) q->phase_end = qc->phase_end;
+            *num_done += qc->done_n;
+        }
+        if(*num_done == sim->prog_n || (*num_done > 0 && sim->stop_early)) stop = 1;
+        run_shared(sim, q);
+
+        q->quanta_n++;
+        q->accesses_n += accesses_n;
+        uint64_t before = sim->trace_n;
+        sim->trace_n += accesses_n;
+        if(sim->warmup_window && sim->trace_n < sim->start_stat && sim->trace_n / sim->warmup_window != before / sim->warmup_window) check_warmup(sim);
+        else if(sim->ci_batch && before >= sim->start_stat && (sim->trace_n - sim->start_stat) / sim->ci_batch != (before - sim->start_stat) / sim->ci_batch) check_confidence(sim);
+        if(sim->trace_n >= sim->max_traces) break;
+        if(sim->trace_n / 100000000 != before / 100000000) printf("Reached %lu accesses in %.2f minutes\n", sim->trace_n, (wall_time() - start)/60.0);
+    }
+    stop_workers(q);
+}
+
+void print_quantum_stats(sim_t* sim) {
+    quantum_t* q = sim->quantum;
+    if(!q) return;
+    printf("Quantum mode: %lu quanta, %lu accesses, %lu (%.2f%%) deferred to the shared caches, timestamp skew mean %.6f max %.6f\n",
+        q->quanta_n, q->accesses_n, q->deferred_n, (q->accesses_n) ? 100.0 * q->deferred_n / q->accesses_n : 0.0,
+        (q->deferred_n) ? q->skew_sum / q->deferred_n : 0.0, q->skew_max);
+}
@@ -0,0 +1,71 @@
+#ifndef QUANTUM_H
+#define QUANTUM_H
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include "sim.h"
+
+/*
+    Quantum mode ; trades exact interleaving of the cores for speed (SYSTEM quantum: or quantum_clock:)
+
+    Every quantum has two phases:
+        1. each core, one after the other, runs its accesses of the quantum through its private caches only ;
+           accesses that miss in every private cache are placed into the first level cache and deferred
+        2. the deferred accesses of all cores go through the shared caches, in timestamp order ;
+           shared cache misses fill the remaining caches as in the strict mode
+    A quantum is either quantum_n accesses per core or a window of quantum_clock core clock time.
+    The strict mode (no quantum) sends every access through all of the caches in timestamp order.
+    sim->trace_n only advances at the end of a quantum, and a process that completes its trace
+    only stops the simulation at the end of the quantum.
+
+    With workers_n > 1, the first phase runs on worker threads (core i on worker i % workers_n).
+    A core's private caches, its process and its counts are only touched by its worker, and the
+    second phase runs on one thread, so the results do not depend on workers_n.
+*/
+
+// accesses of a core that missed in every private cache during the current quantum
+typedef struct quantum_core_t {
+    access_t* deferred; // in timestamp order
+    char* l1_cold; // the deferred access went into a free way of the first level cache (see access_private)
+    int deferred_n;
+    int deferred_size;
+    int next; // next deferred access to send to the shared caches
+
+    uint64_t accesses_n; // accesses of the current quantum
+    double phase_end; // latest timestamp that went through the private caches in the current quantum
+    int done_n; // processes that completed their trace in the current quantum
+} quantum_core_t;
+
+typedef struct quantum_worker_t {
+    int id;
+    sim_t* sim;
+    pthread_t thread;
+} quantum_worker_t;
+
+typedef struct quantum_t {
+    quantum_core_t* cores;
+    access_t* heads; // next deferred access of each core ; orders sim->heap while the shared caches are accessed
+    double window_end; // quantum_clock: end of the current quantum
+    double phase_end; // latest timestamp that went through the private caches in the current quantum
+
+    // workers for the first phase ; the simulation thread is worker 0
+    int workers_n;
+    quantum_worker_t* workers;
+    pthread_barrier_t start; // a quantum can go through the private caches
+    pthread_barrier_t end; // every worker is done with the private caches
+    char running;
+
+    // how far the interleaving is from the strict mode
+    uint64_t quanta_n;
+    uint64_t accesses_n;
+    uint64_t deferred_n;
+    double skew_sum; // skew of a deferred access: how far (in core clock time) the private phase ran past its timestamp
+    double skew_max;
+} quantum_t;
+
+void run_quantum(sim_t* sim, int* num_done);
+void print_quantum_stats(sim_t* sim);
+
+#endif /* QUANTUM_H */
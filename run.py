@@ -11,6 +11,8 @@ def get_next_power2(num):
 
 config_dir = 'config/inclusive/cachelet/'
 prog_dir = 'prog/crypto/'
+sweep = True # one sgxc per prog file simulates all of its configs, reading the traces once ; configs must have the same number of cores
+sweep_threads = 4 # threads per sgxc in a sweep
 
 failed = 0
 config_path = config_dir + '*.config'
@@ -22,6 +24,18 @@ prog_pattern = re.compile('\d+\-\d+')
 failed = []
 executed = []
 progs = []
+def launch(args):
+	print('Will execute: ', args)
+	try:
+		#subprocess.run(args)
+		progs.append(subprocess.Popen(args)) # run in parallel
+	except:
+		print("Running %s failed." % args)
+		failed.append(args)
+		return
+	executed.append(args)
+
+sweeps = {} # prog file -> configs
 for config in glob.glob(config_path):
 	c = os.path.basename(config)
 
@@ -37,18 +51,13 @@ for config in glob.glob(config_path):
 			if get_next_power2(threads_n) != ways_n * max_partition: # the next power of two of thread_n should = ways_n * max_partition 
 				continue
 	
-		args = ['./sgxc', config, prog_file]
-		
-		print('Will execute: ', args)
-		try:
-			#subprocess.run(args)
-			progs.append(subprocess.Popen(args)) # run in parallel
-		except:
-			print("Running %s failed." % config)
-			failed.append(args)
-			continue
-	
-		executed.append(args)
+		if sweep:
+			sweeps.setdefault(prog_file, []).append(config)
+		else:
+			launch(['./sgxc', config, prog_file])
+
+for prog_file, configs in sweeps.items():
+	launch(['./sgxc', '-j', str(sweep_threads)] + configs + [prog_file])
 
 # wait for all programs to finish
 for p in progs:
@@ -8,11 +8,13 @@
 #include <limits.h>
 #include <string.h>
 #include <libgen.h> // basename()
-#include <time.h> // rand()
 
 #include "sim.h"
 #include "utils.h"
+#include "mrc.h"
 #include "cache.h"
+#include "trace.h"
+#include "quantum.h"
 
 // ex. saving the maximum or minimum
 void set_stat_count(nstat_count_t* counts, int EVENT, int enclave_mode, uint64_t new_count) {
@@ -25,37 +27,172 @@ uint64_t get_stat_count(nstat_count_t* counts, int EVENT, int enclave_mode) {
     return counts[EVENT].count[enclave_mode];
 }
 
+// splitmix64 ; every random choice of a sim (random trace offsets, sgx_plru, enclave way eviction) draws from sim->rng
+uint64_t sim_rand(sim_t* sim) {
+    uint64_t z = (sim->rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// uniformly random number in [0, n)
+uint64_t rand_below(sim_t* sim, uint64_t n) {
+    return sim_rand(sim) % n;
+}
+
+// uniformly random number in [0, 1)
+double rand_unit(sim_t* sim) {
+    return (sim_rand(sim) >> 11) * (1.0 / 9007199254740992.0); // 53 bits
+}
+
 void update_stat(sim_t* sim, nstat_count_t* counts, int EVENT, int enclave_mode) {
     if(EVENT >= NUM_EVENTS) return;
 
-    if(sim->trace_n >= START_STAT) {
+    if(sim->trace_n >= sim->start_stat) {
         counts[EVENT].count[enclave_mode]++;
     }
 }
 
+static void sum_warmup(cache_t* c, uint64_t* accesses, uint64_t* misses) {
+    for(int t=0; t<3; t++) {
+        if(!c->config[t]) continue;
+        accesses[c->config[t]->id] += c->warm_accesses[t];
+        misses[c->config[t]->id] += c->warm_misses[t];
+        c->warm_accesses[t] = 0;
+        c->warm_misses[t] = 0;
+    }
+}
+
+// adaptive warmup ; called every warmup_window accesses until start_stat
+// the miss rate of every cache config in the window is compared with the previous window ; once every one changed
+// by at most warmup_tolerance (relative), statistics start with the next access. start_stat bounds the warmup.
+void check_warmup(sim_t* sim) {
+
+    uint64_t accesses[MAX_CACHE_CONFIG] = {0};
+    uint64_t misses[MAX_CACHE_CONFIG] = {0};
+    for(int i=0; i<sim->cores_n; i++) {
+        for(cache_t* c = sim->cores[i].cache; c && c != sim->cache; c = c->next) sum_warmup(c, accesses, misses);
+    }
+    for(cache_t* c = sim->cache; c; c = c->next) sum_warmup(c, accesses, misses);
+
+    char converged = (sim->warmup_windows_n > 0);
+    for(int i=0; i<sim->config_n; i++) {
+        if(accesses[i] == 0) continue; // not used in this window
+        double rate = (double) misses[i] / accesses[i];
+        if(fabs(rate - sim->warmup_rates[i]) > sim->warmup_tolerance * sim->warmup_rates[i]) converged = 0;
+        sim->warmup_rates[i] = rate;
+    }
+    sim->warmup_windows_n++;
+
+    if(converged) {
+        sim->start_stat = sim->trace_n;
+        sim->max_traces = sim->start_stat + sim->stat_traces;
+        printf("Miss rates converged after %" PRIu64 " accesses ; collecting statistics\n", sim->trace_n);
+    }
+}
+
+// two-sided 95% quantiles of Student's t distribution ; index is the degrees of freedom - 1
+static const double t_95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+// quantile above 30 degrees of freedom ; Cornish-Fisher expansion around the normal quantile, within 1e-4 of the exact value
+static double t_95_large(double df) {
+    const double z = 1.959963985;
+    double z3 = z * z * z, z5 = z3 * z * z, z7 = z5 * z * z;
+    return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df) + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * df * df * df);
+}
+
+// width of the 95% confidence interval of the batch means ; -1 with fewer than 2 batches
+double ci_interval(ci_stat_t* ci, double* mean) {
+    *mean = 0;
+    if(ci->batches_n < 2) return -1;
+    double n = ci->batches_n;
+    *mean = ci->sum / n;
+    double var = (ci->sum2 - n * (*mean) * (*mean)) / (n - 1);
+    if(var < 0) var = 0; // rounding
+    uint64_t df = ci->batches_n - 1;
+    double t = (df <= 30) ? t_95[df - 1] : t_95_large(df);
+    return 2 * t * sqrt(var / n);
+}
+
+static void ci_sample(ci_stat_t* ci, double x) {
+    ci->batches_n++;
+    ci->sum += x;
+    ci->sum2 += x * x;
+}
+
+static uint64_t total_count(nstat_count_t* counts, int EVENT) {
+    return counts[EVENT].count[NON_ENCLAVE] + counts[EVENT].count[ENCLAVE];
+}
+
+// early stop ; called every ci_batch accesses after start_stat
+// the LLC miss rate and MPKI of each process in the batch are one sample each ; a process that made no accesses
+// in the batch (context-switched out) has no sample. Once every interval has CI_MIN_BATCHES batches and is at most
+// ci_width of its mean wide, the simulation stops with this access.
+void check_confidence(sim_t* sim) {
+
+    char narrow = 1;
+    for(int i=0; i<sim->cores_n; i++) {
+        core_t* core = &sim->cores[i];
+        for(int j=0; j<core->process_n; j++) {
+            process_t* p = &core->processes[j];
+            if(!p->valid) continue;
+
+            uint64_t now[4] = {
+                total_count(p->nstat_counts, STAT_TRACE),
+                total_count(p->nstat_counts, STAT_LLC_ACCESS),
+                total_count(p->nstat_counts, STAT_CACHE_MISS), // counted per process on LLC misses
+                total_count(p->nstat_counts, STAT_INSN)
+            };
+            uint64_t accesses = now[0] - p->ci_last[0];
+            uint64_t llc_accesses = now[1] - p->ci_last[1];
+            uint64_t misses = now[2] - p->ci_last[2];
+            uint64_t insn = now[3] - p->ci_last[3];
+            memcpy(p->ci_last, now, sizeof(now));
+
+            if(accesses > 0) {
+                ci_sample(&p->ci[CI_LLC_MISS_RATE], (llc_accesses > 0) ? (double) misses / llc_accesses : 0.0);
+                if(insn > 0) ci_sample(&p->ci[CI_MPKI], 1000.0 * misses / insn);
+            }
+            for(int m=0; m<CI_METRICS_N; m++) {
+                double mean;
+                double width = ci_interval(&p->ci[m], &mean);
+                if(p->ci[m].batches_n < CI_MIN_BATCHES || width > sim->ci_width * mean) narrow = 0;
+            }
+        }
+    }
+
+    if(narrow) {
+        sim->max_traces = sim->trace_n;
+        printf("Confidence intervals are within %f of their means after %" PRIu64 " accesses ; stopping\n", sim->ci_width, sim->trace_n);
+    }
+}
+
 void update_stat_all(sim_t* sim, cache_t* c, int cache_type, process_t* p, int EVENT, int enclave_mode) {
-    update_stat(sim, sim->nstat_counts, EVENT, enclave_mode);
+    update_stat(sim, p->core->nstat_counts, EVENT, enclave_mode); // summed into sim->nstat_counts at the end
     update_stat(sim, c->nstat_counts[cache_type], EVENT, enclave_mode);
     update_stat(sim, p->nstat_counts, EVENT, enclave_mode);
 }
 
-void update_stat_mem_access(sim_t* sim, nstat_count_t* counts, int op, int enclave_mode) {
-    
-    int event = STAT_INVALID;
+// event of a memory access of this op
+int mem_access_event(int op) {
     switch(op) {
         case LOAD_OP:
-            event = STAT_LOAD;
-            break;
+            return STAT_LOAD;
         case STORE_OP:
-            event = STAT_STORE;
-            break;
+            return STAT_STORE;
         case INSN_OP:
-            event = STAT_INSN;
-            break;
+            return STAT_INSN;
         default:
-            break;
+            return STAT_INVALID;
     }
-    update_stat(sim, counts, event, enclave_mode);
+}
+
+void update_stat_mem_access(sim_t* sim, nstat_count_t* counts, int op, int enclave_mode) {
+    update_stat(sim, counts, mem_access_event(op), enclave_mode);
     update_stat(sim, counts, STAT_TRACE, enclave_mode);
 }
 
@@ -114,6 +251,16 @@ void write_all_stats(FILE* file, nstat_count_t* counts, char* name, int core_id)
     }
 }
 
+// batch means of a process (see check_confidence) ; width is -1 with fewer than 2 batches
+static void write_confidence(FILE* file, process_t* p, int core_id) {
+    static const char* names[CI_METRICS_N] = {"CI_LLC_MISS_RATE", "CI_MPKI"};
+    for(int m=0; m<CI_METRICS_N; m++) {
+        double mean;
+        double width = ci_interval(&p->ci[m], &mean);
+        fprintf(file, "%s::core%i::%s::mean%f::width%f::batches%lu%16c%s\n", p->tracefile->filename, core_id, names[m], mean, width, p->ci[m].batches_n, '#', "Batch means and width of the 95% confidence interval");
+    }
+}
+
 // records the cache configuration used
 void get_all_config(sim_t* sim) {
    
@@ -200,25 +347,46 @@ void get_all_config(sim_t* sim) {
     "dyn_threshold,"
     "dyn_rate,"
     "dyn_downsize_threshold,"
-    "dyn_downsize_rate\n"
+    "dyn_downsize_rate,"
+    "quantum,"
+    "quantum_clock,"
+    "quantum_deferred,"
+    "quantum_skew_mean,"
+    "quantum_skew_max,"
+    "ci_batch,"
+    "ci_width\n"
 	"%.5f,"
-    "%llu," // START_STAT
-    "%llu," // total traces
+    "%" PRIu64 "," // start_stat
+    "%" PRIu64 "," // total traces
 	"%i," // number of cores
     "%i," // prefetch policy
     "%" PRIu64 "," // dyn_threshold
     "%" PRIu64 "," // dyn_rate
     "%" PRIu64 "," // dyn_downsize_threshold
-    "%" PRIu64 "\n", // dyn_downsize_rate
+    "%" PRIu64 "," // dyn_downsize_rate
+    "%" PRIu64 "," // quantum
+    "%f," // quantum_clock
+    "%" PRIu64 "," // accesses deferred to the shared caches
+    "%f," // timestamp skew of deferred accesses
+    "%f,"
+    "%" PRIu64 "," // ci_batch
+    "%f\n", // ci_width
 	sim->elapsed/60,
-    START_STAT,
-    MAX_TRACES-START_STAT,
+    sim->start_stat,
+    sim->stat_traces,
 	sim->cores_n,
     sim->prefetch,
     sim->dyn_threshold,
     sim->dyn_rate,
     sim->dyn_downsize_threshold,
-    sim->dyn_downsize_rate);
+    sim->dyn_downsize_rate,
+    sim->quantum_n,
+    sim->quantum_clock,
+    (sim->quantum) ? sim->quantum->deferred_n : 0,
+    (sim->quantum && sim->quantum->deferred_n) ? sim->quantum->skew_sum / sim->quantum->deferred_n : 0.0,
+    (sim->quantum) ? sim->quantum->skew_max : 0.0,
+    sim->ci_batch,
+    sim->ci_width);
 
     int ret = fclose(st);
     if(ret != 0) printf("Failed to close %s\n", sim->config_file);
@@ -231,6 +399,13 @@ void get_all_stats(sim_t* sim) {
     if(!file) {
         printf("Failed to open %s\n", sim->nstat_file);
     }
+    // simulation-wide counts are kept per core so that cores can be simulated on different threads
+    for(int i=0; i<sim->cores_n; i++) {
+        for(int e=0; e<NUM_EVENTS; e++) {
+            sim->nstat_counts[e].count[NON_ENCLAVE] += sim->cores[i].nstat_counts[e].count[NON_ENCLAVE];
+            sim->nstat_counts[e].count[ENCLAVE] += sim->cores[i].nstat_counts[e].count[ENCLAVE];
+        }
+    }
     write_all_stats(file, sim->nstat_counts, "sim", 0); // core_id
     
     for(int i=0; i<sim->cores_n; i++) {
@@ -252,6 +427,7 @@ void get_all_stats(sim_t* sim) {
             process_t* p = &core->processes[j];
             if(p->valid) {
                 write_all_stats(file, p->nstat_counts, p->tracefile->filename, core->id);
+                if(sim->ci_batch) write_confidence(file, p, core->id);
             }
         }        
         
@@ -270,33 +446,6 @@ void print_all_events() {
     }
 }
 
-// finds the beginning of a random memory trace in the file
-long int get_rand_trace_offset(char* file_path, size_t size) {
-
-	FILE* fd = fopen(file_path, "r");
-	long int offset = rand() % size;
-	fseek(fd, offset, SEEK_SET); // move to random offset relative to the beginning (SEEK_SET)
-	// look for newline char or end of file
-	int tries = 0;
-	while(1) {
-		char c = fgetc(fd);
-		offset++;
-		if(c == '\n') break;
-		else if(c == EOF) {
-			tries++;
-			if(tries == 3) {
-				offset = 0;
-				break;
-			}
-			offset = rand() % size;
-			fseek(fd, offset, SEEK_SET); // move to random offset relative to the beginning (SEEK_SET)
-		}	
-	}
-	fclose(fd);
-
-	return offset;
-}
-
 void set_next_process(core_t* core) {
 
 	for(int i=0; i<core->process_n; i++) {
@@ -310,6 +459,32 @@ void set_next_process(core_t* core) {
 	return;	
 }
 
+// reads the next access of the core's current process into sim->queue[core->id] and advances the core's clock
+// returns 0 once the simulation should stop (every process, or with stop_early the first one, completed its trace) ;
+// the access is read either way
+int next_access(sim_t* sim, core_t* core, int* num_done) {
+
+	char stop = 0;
+	process_t* p = &core->processes[core->current_process];
+	access_t* a = &sim->queue[core->id];
+	fetch_access(core, p, a); // loops around to the beginning of the trace
+
+	p->records_read++;
+	if(p->records_read > p->tracefile->record_n && !p->done) { // back at its first access ; if completed, process rewinds and continues until the final process completes
+		p->done = 1;
+		(*num_done)++;
+		printf("Process %i completed trace. Will rewind.\n", p->eid);
+		if(*num_done == sim->prog_n || sim->stop_early) stop = 1;
+	}
+
+	a->eid = p->eid;
+	a->core_id = core->id;
+	core->clock += a->interval;
+	a->timestamp = core->clock;
+	if(p->tracefile->always != -1) a->enclave_mode = p->tracefile->always; // if always is set, the entire trace is either always enclave mode or not
+	return !stop;
+}
+
 tracefile_t* add_thread_to_core(sim_t* sim, int core_id) {
 	
 	core_t* core = &sim->cores[core_id];
@@ -339,20 +514,16 @@ tracefile_t* add_thread_to_core(sim_t* sim, int core_id) {
 	p->tracefile = t;	
     p->partition_factor = 0;
     alloc_and_reset_counts(&p->nstat_counts);
+    p->shards = (sim->shards_rate > 0) ? init_shards(sim) : NULL;
 
-    if(t->threads_launched == 1) p->trace_offset = 0;
-	else p->trace_offset = get_rand_trace_offset(t->file_path, t->size); 
-	p->seen_offset_n = 0;	
+    if(t->threads_launched == 1) p->trace_offset = t->data_offset;
+	else p->trace_offset = get_rand_trace_offset(sim, t); 
+	p->records_read = 0;
 	p->offset_table = sim->offset_table;
 	
 	core->process_n++;
 	
-	p->trace = fopen(p->tracefile->file_path, "r");
-	if(!p->trace) {
-		perror("Failed to open trace file.\n");
-		exit(1);
-	}
-	fseek(p->trace, p->trace_offset, SEEK_SET); // move to its assigned offset
+	seek_trace(p, p->trace_offset); // move to its assigned offset
  
 	printf("Process %i (%s) scheduled onto core %i (offset %li)\n", p->eid, p->tracefile->filename, core->id, p->trace_offset);
 	return t;
@@ -374,6 +545,10 @@ void parse_files(sim_t* sim, char* config, char* prog_file) {
 	} 
 
 	sim->cores_n = -1; // if cores_n was not specified, will use # of threads as # of cores
+	sim->start_stat = START_STAT;
+	sim->stat_traces = MAX_TRACES - START_STAT;
+	sim->warmup_tolerance = WARMUP_TOLERANCE;
+	sim->seed = 1;
 	char system = 0;	
 	while(!feof(r)) {
 		char* line = NULL;	
@@ -419,6 +594,34 @@ void parse_files(sim_t* sim, char* config, char* prog_file) {
                     sim->ignore_ne = atoi(param);
                     if(sim->ignore_ne) printf("Will ignore all non-enclave memory accesses.\n");
                 }
+                else if(strcmp("decoders_n:", param_type) == 0) sim->decoders_n = atoi(param);
+                else if(strcmp("start_stat:", param_type) == 0) sim->start_stat = strtoull(param, NULL, 10);
+                else if(strcmp("stat_traces:", param_type) == 0) sim->stat_traces = strtoull(param, NULL, 10);
+                else if(strcmp("warmup_window:", param_type) == 0) sim->warmup_window = strtoull(param, NULL, 10);
+                else if(strcmp("warmup_tolerance:", param_type) == 0) sim->warmup_tolerance = atof(param);
+                else if(strcmp("ci_batch:", param_type) == 0) sim->ci_batch = strtoull(param, NULL, 10);
+                else if(strcmp("ci_width:", param_type) == 0) sim->ci_width = atof(param);
+                else if(strcmp("detailed_warmup:", param_type) == 0) sim->detailed_warmup = atoi(param);
+                else if(strcmp("seed:", param_type) == 0) sim->seed = strtoull(param, NULL, 10);
+                else if(strcmp("quantum:", param_type) == 0) {
+                    sim->quantum_n = strtoull(param, NULL, 10);
+                    if(sim->quantum_n) printf("Quantum mode: %lu accesses per core per quantum\n", sim->quantum_n);
+                }
+                else if(strcmp("workers_n:", param_type) == 0) sim->workers_n = atoi(param);
+                else if(strcmp("quantum_clock:", param_type) == 0) {
+                    sim->quantum_clock = atof(param);
+                    if(sim->quantum_clock > 0) printf("Quantum mode: quanta of %f core clock time\n", sim->quantum_clock);
+                }
+                else if(strcmp("mrc_ways:", param_type) == 0) sim->mrc_ways = atoi(param);
+                else if(strcmp("mrc_sets:", param_type) == 0) { // mrc_sets: <min> <max>
+                    sim->mrc_sets_min = atoi(param);
+                    char* max = strtok(NULL, " ");
+                    sim->mrc_sets_max = (max) ? atoi(max) : sim->mrc_sets_min;
+                }
+                else if(strcmp("shards_rate:", param_type) == 0) sim->shards_rate = atof(param);
+                else if(strcmp("shards_lines:", param_type) == 0) sim->shards_lines = atoi(param);
+                else if(strcmp("checkpoint_save:", param_type) == 0) sim->checkpoint_save = strdup(param);
+                else if(strcmp("checkpoint_load:", param_type) == 0) sim->checkpoint_load = strdup(param);
                 else if(strcmp("cachelet_assoc:", param_type) == 0) {
                     sim->cachelet_assoc = atoi(param);
                     printf("Cachelet associativity: %i\n", sim->cachelet_assoc);
@@ -503,6 +706,9 @@ void parse_files(sim_t* sim, char* config, char* prog_file) {
 	fclose(r);
 
 	sim->config_n = cache + 1;
+	sim->max_traces = sim->start_stat + sim->stat_traces;
+	if(sim->ci_batch) printf("Early stop: batches of %" PRIu64 " accesses, 95%% confidence intervals within %f of their means\n", sim->ci_batch, sim->ci_width);
+	if(sim->warmup_window) printf("Adaptive warmup: windows of %" PRIu64 " accesses, tolerance %f, at most %" PRIu64 " accesses\n", sim->warmup_window, sim->warmup_tolerance, sim->start_stat);
 
 	/* parse .prog file */
 	r = fopen(prog_file, "r");	
@@ -551,15 +757,7 @@ void parse_files(sim_t* sim, char* config, char* prog_file) {
             memset(t->file_path, 0, path_len);
             strcpy(t->file_path, traces_dir);
             strcat(t->file_path, t->filename);
-			FILE* fd = fopen(t->file_path, "r");
-			if(!fd) {
-				printf("Failed to open file %s\n", t->file_path);
-				exit(1);
-			}
-
-			fseek(fd, 0, SEEK_END);
-			t->size = ftell(fd);
-			fclose(fd);
+			open_tracefile(t); // size and format of the trace
 
 			sim->tracefiles_n++;
 			sim->prog_n += t->threads_n;
@@ -570,16 +768,20 @@ void parse_files(sim_t* sim, char* config, char* prog_file) {
 	if(sim->cores_n == -1) sim->cores_n = sim->prog_n;
 }
 
-void init_sim(sim_t* sim, char* argv[]) {	
+void init_sim(sim_t* sim, char* config, char* prog_file) {	
 
-    char* config = argv[1];
-    char* prog_file = argv[2];
+    config = strdup(config); // basename() and remove_substring() edit the names in place
+    prog_file = strdup(prog_file);
 	memset(sim, 0, sizeof(sim_t));	
 	alloc_and_reset_counts(&sim->nstat_counts);
 
 	parse_files(sim, config, prog_file);	
+	sim->rng = sim->seed;
 	init_cache(sim);	
+	init_mrc(sim);
     sim->queue = malloc(sizeof(access_t) * sim->cores_n);
+    sim->heap = malloc(sizeof(int) * sim->cores_n);
+    sim->heap_n = 0;
 	
 	// 2 traces , .results.csv contains all the compiled statistics, and .graph.csv for graph data
 	char* b_config = basename(config);
@@ -600,6 +802,14 @@ void init_sim(sim_t* sim, char* argv[]) {
     strcpy(sim->config_file, trace_id);
     strcat(sim->config_file, ".config.csv");
 
+    sim->mrc_file = malloc(strlen(trace_id) + strlen(".mrc.csv") + 1); // +1 null terminator
+    strcpy(sim->mrc_file, trace_id);
+    strcat(sim->mrc_file, ".mrc.csv");
+
+    sim->shards_file = malloc(strlen(trace_id) + strlen(".shards.csv") + 1); // +1 null terminator
+    strcpy(sim->shards_file, trace_id);
+    strcat(sim->shards_file, ".shards.csv");
+
     if(sim->dyn_threshold > 0) {
         char* f = malloc(strlen(trace_id) + strlen(".misses.csv") + 1); // +1 null terminator
         strcpy(f, trace_id);
@@ -624,11 +834,13 @@ void init_sim(sim_t* sim, char* argv[]) {
     // save eid -> core_id mapping
     sim->eid_to_core_id = (int*) malloc(sim->prog_n * sizeof(int));
     memset(sim->eid_to_core_id, -1, sim->prog_n * sizeof(int));
+    sim->eid_to_process = (process_t**) calloc(sim->prog_n, sizeof(process_t*));
     for(int i=0; i<sim->cores_n; i++) {
         core_t* core = &sim->cores[i];
         for(int j=0; j<core->process_n; j++) {
             process_t* p = &core->processes[j];
             sim->eid_to_core_id[p->eid] = core->id;
+            sim->eid_to_process[p->eid] = p;
         }
     }
 
@@ -13,12 +13,26 @@
 #define MAX_TRACEFILES 32 // maximum number of unique trace files
 #define TRACE_N_CONTEXT_SWITCH 1000 // arbitrary
 
-#define START_STAT 100000000ull // start collecting stats after this many traces
-#define MAX_TRACES (START_STAT + 10000000000ull) // when to stop simulation
+#define START_STAT 100000000ull // start collecting stats after this many traces ; default of SYSTEM start_stat:
+#define MAX_TRACES (START_STAT + 10000000000ull) // when to stop simulation ; default of SYSTEM stat_traces: is MAX_TRACES - START_STAT
+
+#define WARMUP_TOLERANCE 0.02 // default of SYSTEM warmup_tolerance:
+
+// early stop (see check_confidence) ; batch means of the LLC miss rate and MPKI of every process
+#define CI_LLC_MISS_RATE 0
+#define CI_MPKI 1
+#define CI_METRICS_N 2
+#define CI_MIN_BATCHES 10 // no interval is trusted before this many batches
 
 typedef struct cache_config_t cache_config_t;
 typedef struct cache_t cache_t;
 typedef struct core_t core_t;
+typedef struct level_t level_t;
+typedef struct access_ring_t access_ring_t;
+typedef struct decoder_t decoder_t;
+typedef struct quantum_t quantum_t;
+typedef struct mrc_t mrc_t;
+typedef struct shards_t shards_t;
 
 typedef struct nstat_t {
     char name[256];
@@ -52,12 +66,28 @@ static const nstat_t all_stats[NUM_EVENTS] =
 
 enum PrefetchPolicy{prefetchNone=0, nextLine=1, nextTwoLines=2};
 
+// batch means of one metric
+typedef struct ci_stat_t {
+    uint64_t batches_n;
+    double sum;
+    double sum2; // of squares
+} ci_stat_t;
+
 typedef struct tracefile_t {
 	char filename[256];
 	char* file_path;
+    char* map; // the trace file mapped into memory ; shared by every process of this trace
     size_t size; // for choosing a random offset within range
     int always; // treat either as always enclave mode or not ; -1 if trace mixes
 
+    int format; // TRACE_FMT_TEXT, TRACE_FMT_BINARY or TRACE_FMT_COMPRESSED, read from the file header
+    uint64_t record_n; // number of accesses ; for text traces, the number of lines
+    long int data_offset; // file offset of the first access
+    long int index_offset; // compressed traces: file offset of the block index
+    uint64_t blocks_n; // compressed traces: number of blocks
+    uint64_t* line_index; // text traces: file offset of every line_stride-th line (see trace.h)
+    uint64_t line_stride;
+
 	int threads_n;
 	int threads_launched; // number of threads that were scheduled onto a core
     int threads_completed; // number of threads that read through entire trace file
@@ -75,16 +105,26 @@ typedef struct access_t {
 	double timestamp;
 } access_t;
 
+// decoder state of a compressed trace ; reset at the start of every block
+typedef struct trace_stream_t {
+    uint32_t block_left; // accesses left in the current block
+    uint32_t run_left; // accesses left in the current run
+    int enclave_mode; // of the current run
+    double interval; // of the current run
+    uint64_t prev_addr[3]; // last address of each op
+} trace_stream_t;
+
 typedef struct process_t {	
 	char valid; // a core may have have room for more processes then there are processes
 	int eid; // unique id across cores and run
 	char done;
     access_t* access; // holds the current access
 	
-	FILE* trace; // file stream		
+	char* cursor; // next access to read in tracefile->map
+	trace_stream_t stream; // compressed traces only
 	tracefile_t* tracefile; // tracefile info	
 	long int trace_offset; // starting offset into the trace file
-	int seen_offset_n; // how many times looped around trace file
+	uint64_t records_read; // accesses read from the trace ; the trace is complete once every record was read
 	
 	core_t* core;
 
@@ -98,6 +138,11 @@ typedef struct process_t {
     // dynamic cachelets
     uint64_t miss_counter; // indicates when the size expands
     int num_cachelets; // used to compute the range of accessible cache sets
+
+    shards_t* shards; // sampled miss-ratio curve ; NULL when off
+
+    ci_stat_t ci[CI_METRICS_N]; // batch means of the LLC miss rate and MPKI ; sim->ci_batch
+    uint64_t ci_last[4]; // accesses, LLC accesses, LLC misses and instructions at the end of the last batch
 } process_t;
 
 typedef struct core_t {
@@ -110,7 +155,11 @@ typedef struct core_t {
 
 	int** offset_table;
 	cache_t* cache; // private to core
-    //nstat_count_t* nstat_counts;
+    level_t* levels; // every cache level an access of this core goes through, first level first ; see init_levels()
+    int levels_n;
+    int private_n; // levels before the shared caches
+	access_ring_t* ring; // accesses decoded ahead of time by a decoder thread ; NULL if decoded when needed
+    nstat_count_t* nstat_counts; // simulation-wide stats of accesses made on this core ; summed in get_all_stats()
 } core_t;
 
 typedef struct sim_t {	
@@ -119,14 +168,51 @@ typedef struct sim_t {
     char test; // if testing a new feature while things are running, the config files should specify test: 1
     enum PrefetchPolicy prefetch; // prefetching policy 
     char ignore_ne; // if true, ignore all non-enclave accesses
+    char detailed_warmup; // if true, the warmup goes through access_cache() instead of warm_cache()
     uint64_t trace_n; // indicates when to start simulating
+    uint64_t start_stat; // stats are collected from this access on
+    uint64_t max_traces; // when to stop simulation ; start_stat + stat_traces
+    uint64_t stat_traces; // accesses to collect stats for
+
+    // adaptive warmup (see check_warmup) ; off when warmup_window is 0
+    uint64_t warmup_window; // accesses per window
+    double warmup_tolerance; // largest relative change of a miss rate between windows
+    uint64_t warmup_windows_n;
+    double warmup_rates[MAX_CACHE_CONFIG]; // miss rate of each cache config in the last window
+
+    // early stop (see check_confidence) ; off when ci_batch is 0
+    uint64_t ci_batch; // accesses per batch
+    double ci_width; // largest width of every 95% confidence interval, relative to its mean
+
+    // random draws (see sim_rand) ; each sim has its own state, so configs simulated together draw what they would alone
+    uint64_t seed;
+    uint64_t rng;
     int cachelet_assoc; // how many ways each cachelet gets
     int max_partition;
 	
 	tracefile_t tracefiles[MAX_TRACEFILES];
 	int tracefiles_n;
 	int tracefile_ptr; // which thread to schedule next
-	access_t* queue; // queue of traces
+	int decoders_n; // number of threads decoding traces ahead of the simulation ; 0 decodes on the simulation thread
+	decoder_t* decoders;
+	access_t* queue; // pending access of each core ; indexed by core id
+	int* heap; // cores ordered by the timestamp of their pending access (see heap_push)
+	int heap_n;
+
+	// quantum mode (see quantum.h) ; off when both are 0
+	uint64_t quantum_n; // accesses per core per quantum
+	double quantum_clock; // length of a quantum in core clock time
+	int workers_n; // threads simulating the cores ; their first level caches (see sweep.h), or in quantum mode their private caches
+	char private_phase; // the caches being searched are private ; set while a quantum runs through the private caches
+	quantum_t* quantum;
+
+	// miss-ratio curves of the shared cache (see mrc.h) ; off when mrc_ways is 0
+	int mrc_ways;
+	int mrc_sets_min;
+	int mrc_sets_max;
+	mrc_t* mrc;
+	double shards_rate; // sampled miss-ratio curves of each process ; off when 0
+	int shards_lines; // most lines sampled per process
 	
 	cache_config_t* config;
     int config_n; // number of cache configs
@@ -136,6 +222,7 @@ typedef struct sim_t {
 	int cores_n;
 	int progs_per_core;
     int* eid_to_core_id; // index using eid ; obtain the id of the core this process is located ; used when evicting other lines with inclusive policy
+    process_t** eid_to_process; // index using eid
 
     char uses_inclusive; // if true, then there is an inclusive cache somewhere in the cache hierarchy, so evictions may cause additional evictions
 	cache_t* cache; // shared cache		
@@ -145,6 +232,10 @@ typedef struct sim_t {
 
     char* nstat_file; // <config>.<prog>.nstat.csv
     char* config_file; // <config>.<prog>.config.csv
+    char* mrc_file; // <config>.<prog>.mrc.csv
+    char* shards_file; // <config>.<prog>.shards.csv
+    char* checkpoint_save; // write the state after warmup to this file (see checkpoint.h) ; NULL if off
+    char* checkpoint_load; // start from the state in this file ; NULL if off
     nstat_count_t* nstat_counts;
 
     // dynamic cachelets
@@ -162,16 +253,25 @@ void print_all_events();
 void get_all_stats(sim_t* sim);
 void get_all_config(sim_t* sim);
 
+void check_warmup(sim_t* sim);
+double ci_interval(ci_stat_t* ci, double* mean);
+void check_confidence(sim_t* sim);
+
 void set_stat_count(nstat_count_t* counts, int EVENT, int enclave_mode, uint64_t new_count);
 uint64_t get_stat_count(nstat_count_t* counts, int EVENT, int enclave_mode);
 void update_stat_all(sim_t* sim, cache_t* c, int cache_type, process_t* p, int EVENT, int enclave_mode);
 void update_stat(sim_t* sim, nstat_count_t* counts, int EVENT, int enclave_mode);
 void update_stat_mem_access(sim_t* sim, nstat_count_t* counts, int op, int enclave_mode);
+int mem_access_event(int op);
+uint64_t sim_rand(sim_t* sim);
+uint64_t rand_below(sim_t* sim, uint64_t n);
+double rand_unit(sim_t* sim);
 void update_stat_partition_time(sim_t* sim, nstat_count_t* counts, int partition_factor, int enclave_mode);
 void alloc_and_reset_counts(nstat_count_t** counts);
 
 void parse_files(sim_t* sim, char* config, char* prog_file);
 void set_next_process(core_t* core);
-void init_sim(sim_t* sim, char* argv[]);
+int next_access(sim_t* sim, core_t* core, int* num_done);
+void init_sim(sim_t* sim, char* config, char* prog_file);
 
 #endif /* SIM_H */
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "sweep.h"
+#include "cache.h"
+#include "trace.h"
+#include "utils.h"
+#include "checkpoint.h"
+
+// every sim must schedule the same processes onto the same cores ; replicas start at the primary's trace offsets
+void check_sweep(sweep_t* sweep) {
+
+    sim_t* primary = &sweep->sims[0];
+    for(int s=1; s<sweep->sims_n; s++) {
+        sim_t* sim = &sweep->sims[s];
+        if(sim->cores_n != primary->cores_n || sim->prog_n != primary->prog_n || sim->progs_per_core != primary->progs_per_core) {
+            printf("Configs in a sweep must have the same number of cores (%s: %i, %s: %i)\n", primary->config_file, primary->cores_n, sim->config_file, sim->cores_n);
+            exit(1);
+        }
+        if(sim->quantum_n > 0 || sim->quantum_clock > 0) {
+            printf("Quantum mode runs one config at a time (%s)\n", sim->config_file);
+            exit(1);
+        }
+        if(sim->seed != primary->seed) { // the trace offsets are those of the first config
+            printf("Configs in a sweep must have the same seed (%s: %" PRIu64 ", %s: %" PRIu64 ")\n", primary->config_file, primary->seed, sim->config_file, sim->seed);
+            exit(1);
+        }
+        if(!sim->checkpoint_load != !primary->checkpoint_load) {
+            printf("Either every config in a sweep starts from a checkpoint or none does (%s)\n", sim->config_file);
+            exit(1);
+        }
+
+        for(int i=0; i<sim->cores_n; i++) {
+            core_t* core = &sim->cores[i];
+            for(int j=0; j<core->process_n; j++) {
+                process_t* p = &core->processes[j];
+                process_t* primary_p = &primary->cores[i].processes[j];
+                assert(p->eid == primary_p->eid);
+                p->trace_offset = primary_p->trace_offset;
+                seek_trace(p, p->trace_offset);
+            }
+        }
+    }
+}
+
+static void simulate_batch(sweep_t* sweep, sim_t* sim) {
+
+    for(int i=0; i<sweep->batch_n && sim->trace_n < sim->max_traces; i++) {
+        access_t a = sweep->batch[i]; // sims on other threads read the same batch
+        core_t* core = &sim->cores[a.core_id];
+
+        if(sim->ignore_ne && a.enclave_mode == 0) sim->trace_n++;
+        else {
+            process_t* p = &core->processes[core->current_process];
+            assert(p->valid);
+
+            p->access = &a;
+            if(sim->trace_n < sim->start_stat && !sim->detailed_warmup) warm_cache(sim, p); // statistics are not counted yet
+            else access_cache(sim, p); // send cache access to sim
+
+            // stats
+            sim->trace_n++;
+            update_stat_mem_access(sim, core->nstat_counts, a.op, a.enclave_mode);
+        }
+
+        if(sim->warmup_window && sim->trace_n < sim->start_stat && sim->trace_n % sim->warmup_window == 0) check_warmup(sim);
+        else if(sim->ci_batch && sim->trace_n > sim->start_stat && (sim->trace_n - sim->start_stat) % sim->ci_batch == 0) check_confidence(sim);
+    }
+}
+
+static void simulate_sims(sweep_t* sweep, int worker_id) {
+    for(int s=worker_id; s<sweep->sims_n; s+=sweep->workers_n) simulate_batch(sweep, &sweep->sims[s]);
+}
+
+// a core's first level cache only changes with its own accesses: no cache reaches back into it (inclusion, prefetches),
+// and it shares no state with other cores (partitions, cachelets) and draws no random numbers ; statistics are only read
+// at the end of the run
+static char first_level_safe(sim_t* sim) {
+    if(sim->uses_inclusive || sim->prefetch || sim->warmup_window || sim->ci_batch) return 0;
+    if(sim->dyn_threshold > 0 || sim->dyn_rate > 0 || sim->dyn_downsize_threshold > 0) return 0;
+    for(int i=0; i<sim->cores_n; i++) {
+        if(sim->cores[i].process_n > 0 && !sim->cores[i].levels[0].fast) return 0; // shared, or the last level
+    }
+    for(int i=0; i<sim->config_n; i++) {
+        cache_config_t* c = &sim->config[i];
+        if(c->level != 1) continue;
+        if(c->partition || c->set_partition || c->use_cachelet) return 0;
+        if(c->evict_policy == EVICT_SGX_PLRU || c->evict_policy == EVICT_RAND) return 0;
+    }
+    return 1;
+}
+
+// first phase of a batch with split_levels ; the accesses of core i go through its first level cache on worker i % workers_n
+static void simulate_first_level(sweep_t* sweep, int worker_id) {
+
+    sim_t* sim = &sweep->sims[0];
+    char warm = (sim->trace_n < sim->start_stat && !sim->detailed_warmup); // a batch is either warmup or statistics
+    for(int i=0; i<sweep->batch_n && sim->trace_n + i < sim->max_traces; i++) {
+        access_t* a = &sweep->batch[i];
+        if(a->core_id % sweep->workers_n != worker_id) continue;
+        sweep->missed[i] = 0;
+        if(sim->ignore_ne && a->enclave_mode == 0) continue;
+
+        core_t* core = &sim->cores[a->core_id];
+        process_t* p = &core->processes[core->current_process];
+        assert(p->valid);
+        p->access = a;
+        sweep->missed[i] = access_first_level(sim, p, warm, &sweep->l1_cold[i]);
+    }
+}
+
+// second phase ; the accesses that missed in the first level caches go through the other levels in the order they were scheduled
+static void commit_batch(sweep_t* sweep) {
+
+    sim_t* sim = &sweep->sims[0];
+    char warm = (sim->trace_n < sim->start_stat && !sim->detailed_warmup);
+    for(int i=0; i<sweep->batch_n && sim->trace_n < sim->max_traces; i++) {
+        access_t* a = &sweep->batch[i];
+        if(sim->ignore_ne && a->enclave_mode == 0) {
+            sim->trace_n++;
+            continue;
+        }
+
+        core_t* core = &sim->cores[a->core_id];
+        if(sweep->missed[i]) {
+            process_t* p = &core->processes[core->current_process];
+            p->access = a;
+            access_other_levels(sim, p, warm, sweep->l1_cold[i]);
+        }
+
+        // as in simulate_batch() ; the core's count is taken after trace_n moves
+        sim->trace_n++;
+        update_stat_mem_access(sim, core->nstat_counts, a->op, a->enclave_mode);
+    }
+}
+
+static void simulate_worker(sweep_t* sweep, int worker_id) {
+    if(sweep->split_levels) simulate_first_level(sweep, worker_id);
+    else simulate_sims(sweep, worker_id);
+}
+
+static void* worker_loop(void* arg) {
+
+    sweep_worker_t* w = (sweep_worker_t*) arg;
+    sweep_t* sweep = w->sweep;
+
+    while(1) {
+        pthread_barrier_wait(&sweep->start);
+        if(!sweep->running) break;
+        simulate_worker(sweep, w->id);
+        pthread_barrier_wait(&sweep->end);
+    }
+    return NULL;
+}
+
+static void start_workers(sweep_t* sweep) {
+
+    sim_t* sim = &sweep->sims[0];
+    if(sweep->sims_n == 1 && sim->workers_n > 1 && sim->cores_n > 1) { // SYSTEM workers_n: ; threads across the cores
+        if(first_level_safe(sim)) {
+            sweep->split_levels = 1;
+            sweep->workers_n = (sim->workers_n < sim->cores_n) ? sim->workers_n : sim->cores_n;
+            sweep->missed = malloc(SWEEP_BATCH_N);
+            sweep->l1_cold = malloc(SWEEP_BATCH_N);
+            printf("Simulating the first level caches of %i cores on %i threads\n", sim->cores_n, sweep->workers_n);
+        } else printf("workers_n: inclusive caches, prefetching, adaptive warmup, early stop, dynamic cachelets or first level caches with partitions, cachelets or sgx_plru/random eviction are simulated on 1 thread\n");
+    }
+    if(!sweep->split_levels && sweep->workers_n > sweep->sims_n) sweep->workers_n = sweep->sims_n;
+    if(sweep->workers_n < 1) sweep->workers_n = 1;
+    if(sweep->workers_n == 1) return;
+
+    if(!sweep->split_levels) printf("Simulating %i configs on %i threads\n", sweep->sims_n, sweep->workers_n);
+    sweep->running = 1;
+    pthread_barrier_init(&sweep->start, NULL, sweep->workers_n);
+    pthread_barrier_init(&sweep->end, NULL, sweep->workers_n);
+    sweep->workers = malloc(sweep->workers_n * sizeof(sweep_worker_t));
+    for(int i=1; i<sweep->workers_n; i++) {
+        sweep_worker_t* w = &sweep->workers[i];
+        w->id = i;
+        w->sweep = sweep;
+        if(pthread_create(&w->thread, NULL, worker_loop, w) != 0) error("Failed to create sweep worker");
+    }
+}
+
+static void stop_workers(sweep_t* sweep) {
+    free(sweep->missed);
+    free(sweep->l1_cold);
+    if(sweep->workers_n == 1) return;
+    sweep->running = 0;
+    pthread_barrier_wait(&sweep->start); // workers see running == 0
+    for(int i=1; i<sweep->workers_n; i++) pthread_join(sweep->workers[i].thread, NULL);
+    pthread_barrier_destroy(&sweep->start);
+    pthread_barrier_destroy(&sweep->end);
+}
+
+// a batch ends where a config's statistics may start, so its checkpoint holds the state at that access
+static char checkpoint_boundary(sweep_t* sweep, uint64_t n) {
+    for(int s=0; s<sweep->sims_n; s++) {
+        sim_t* sim = &sweep->sims[s];
+        if(!sim->checkpoint_save) continue;
+        if(n == sim->start_stat) return 1;
+        if(sim->warmup_window && n < sim->start_stat && n % sim->warmup_window == 0) return 1; // see check_warmup
+    }
+    return 0;
+}
+
+// main simulation loop ; every access goes through all of the caches in timestamp order
+void run_sweep(sweep_t* sweep, int* num_done) {
+
+    sim_t* sim = &sweep->sims[0]; // schedules the accesses
+    double start = wall_time();
+    sweep->batch = malloc(SWEEP_BATCH_N * sizeof(access_t));
+    start_workers(sweep);
+
+	// every core with a process has one pending access in sim->queue ; the core with the earliest one is advanced next
+	char stop = 0;
+	for(int i=0; i<sim->cores_n && !stop && !sweep->restored; i++) {
+		core_t* core = &sim->cores[i];
+		if(core->current_process < 0) continue;
+		if(next_access(sim, core, num_done)) heap_push(sim->heap, &sim->heap_n, sim->queue, core->id);
+		else stop = 1;
+	}
+
+    char save = 0;
+    for(int s=0; s<sweep->sims_n; s++) if(sweep->sims[s].checkpoint_save) save = 1;
+
+    uint64_t scheduled_n = sim->trace_n;
+    while(!stop && sim->heap_n > 0) {
+
+        uint64_t max_traces = 0; // the last config to stop ; adaptive warmup moves max_traces
+        for(int s=0; s<sweep->sims_n; s++) if(sweep->sims[s].max_traces > max_traces) max_traces = sweep->sims[s].max_traces;
+
+        sweep->batch_n = 0;
+        while(sweep->batch_n < SWEEP_BATCH_N) {
+            core_t* core = &sim->cores[sim->heap[0]];
+            sweep->batch[sweep->batch_n++] = sim->queue[core->id];
+            scheduled_n++;
+            if(scheduled_n >= max_traces) {
+                stop = 1;
+                break;
+            }
+
+            // refill only this core's slot
+            if(!next_access(sim, core, num_done)) {
+                stop = 1;
+                break;
+            }
+            heap_sift_down(sim->heap, sim->heap_n, sim->queue);
+            if(save && checkpoint_boundary(sweep, scheduled_n)) break;
+            if(sweep->split_levels && scheduled_n == sim->start_stat) break; // see simulate_first_level()
+        }
+
+        if(sweep->workers_n > 1) pthread_barrier_wait(&sweep->start);
+        simulate_worker(sweep, 0);
+        if(sweep->workers_n > 1) pthread_barrier_wait(&sweep->end);
+        if(sweep->split_levels) commit_batch(sweep);
+
+        for(int s=0; s<sweep->sims_n && save && !stop; s++) {
+            sim_t* saved = &sweep->sims[s];
+            if(saved->checkpoint_save && saved->trace_n == saved->start_stat && scheduled_n == saved->start_stat) save_checkpoint(saved, sim, *num_done);
+        }
+
+        if(sim->trace_n / 100000000 != (sim->trace_n - sweep->batch_n) / 100000000) printf("Reached %lu accesses in %.2f minutes\n", sim->trace_n, (wall_time() - start)/60.0);
+    }
+
+    stop_workers(sweep);
+    free(sweep->batch);
+}
@@ -0,0 +1,61 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include "sim.h"
+
+/*
+    Strict simulation loop for one or more configs ; ./sgxc [-j <threads>] <.config> [<.config> ...] <.prog>
+
+    The first sim (the primary) reads the traces and schedules the accesses: a min-heap of cores ordered by the
+    timestamp of their pending access (sim->queue) always advances the earliest core. Scheduled accesses are
+    collected in batches, and every sim, each with its own cache hierarchy, simulates every batch. Scheduling only
+    depends on the traces and the number of cores, so all sims see the same accesses in the same order as if they
+    were run alone. With workers_n > 1, sim i simulates its batches on worker i % workers_n.
+
+    A single config with SYSTEM workers_n: > 1 instead splits each batch across the cores (split_levels): first the
+    accesses of core i go through its first level cache on worker i % workers_n, then the ones that missed there go
+    through the other levels on the simulation thread, in the order they were scheduled. This only gives the results
+    of the single-threaded run where a first level cache does not depend on any other access (see first_level_safe()),
+    else the batch runs on one thread. Batches end at start_stat, so every access of a batch is counted alike.
+*/
+
+#define SWEEP_BATCH_N 4096 // accesses scheduled before the sims simulate them
+
+typedef struct sweep_t sweep_t;
+
+typedef struct sweep_worker_t {
+    int id;
+    sweep_t* sweep;
+    pthread_t thread;
+} sweep_worker_t;
+
+typedef struct sweep_t {
+    sim_t* sims; // sims[0] reads the traces
+    int sims_n;
+
+    access_t* batch; // scheduled accesses
+    int batch_n;
+
+    // workers ; the simulation thread is worker 0
+    int workers_n;
+    sweep_worker_t* workers;
+    pthread_barrier_t start; // a batch is ready
+    pthread_barrier_t end; // every worker simulated the batch
+    char running;
+
+    // split_levels ; per access of the batch
+    char split_levels;
+    char* missed; // missed in the first level cache
+    char* l1_cold; // and went into a free way there (see access_first_level)
+
+    char restored; // the sims start from checkpoints (see checkpoint.h) ; sims[0]->queue and heap hold the pending accesses
+} sweep_t;
+
+void check_sweep(sweep_t* sweep);
+void run_sweep(sweep_t* sweep, int* num_done);
+
+#endif /* SWEEP_H */
@@ -0,0 +1,461 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h> // open()
+#include <unistd.h> // close()
+#include <sys/mman.h> // mmap()
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "utils.h"
+
+// powers of 10 that are exact as doubles ; used to parse intervals
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// returns 1 if the mapped file is a binary trace and fills header
+int read_trace_header(const char* map, size_t size, trace_header_t* header) {
+
+    memset(header, 0, sizeof(trace_header_t));
+    if(size < sizeof(trace_header_t)) return 0; // too short to be a binary trace
+    memcpy(header, map, sizeof(trace_header_t));
+    if(memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0) return 0;
+
+    if(header->version < 1 || header->version > TRACE_VERSION) {
+        printf("Unsupported trace version %u (expected %u or older)\n", header->version, TRACE_VERSION);
+        exit(1);
+    }
+    if(header->record_size != sizeof(trace_record_t)) {
+        printf("Unexpected trace record size %u (expected %zu)\n", header->record_size, sizeof(trace_record_t));
+        exit(1);
+    }
+    return 1;
+}
+
+// reads <trace>.idx if it was built for this version of the trace ; returns 1 on success
+static int load_line_index(tracefile_t* t, const char* idx_path, const struct stat* st) {
+
+    FILE* f = fopen(idx_path, "r");
+    if(!f) return 0;
+
+    trace_index_header_t h;
+    int ok = fread(&h, sizeof(trace_index_header_t), 1, f) == 1 &&
+             memcmp(h.magic, TRACE_INDEX_MAGIC, sizeof(h.magic)) == 0 &&
+             h.version == TRACE_INDEX_VERSION &&
+             h.source_size == (uint64_t) st->st_size &&
+             h.source_mtime_ns == (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec &&
+             h.stride > 0 && h.offsets_n == (h.record_n + h.stride - 1) / h.stride;
+    if(ok) {
+        t->line_index = malloc(h.offsets_n * sizeof(uint64_t));
+        ok = fread(t->line_index, sizeof(uint64_t), h.offsets_n, f) == h.offsets_n;
+        if(ok) {
+            t->record_n = h.record_n;
+            t->line_stride = h.stride;
+        } else {
+            free(t->line_index);
+            t->line_index = NULL;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+// counts the lines of a text trace and records where every TRACE_INDEX_STRIDE-th line starts ; cached in <trace>.idx
+static void build_line_index(tracefile_t* t, const char* idx_path, const struct stat* st) {
+
+    uint64_t offsets_size = 1024;
+    t->line_index = malloc(offsets_size * sizeof(uint64_t));
+    t->line_stride = TRACE_INDEX_STRIDE;
+    t->record_n = 0;
+
+    const char* s = t->map;
+    const char* end = t->map + t->size;
+    while(s < end) { // a line ends with '\n' or at the end of the file, like in read_access()
+        if(t->record_n % t->line_stride == 0) {
+            uint64_t i = t->record_n / t->line_stride;
+            if(i == offsets_size) {
+                offsets_size *= 2;
+                t->line_index = realloc(t->line_index, offsets_size * sizeof(uint64_t));
+            }
+            t->line_index[i] = s - t->map;
+        }
+        t->record_n++;
+        const char* line_end = memchr(s, '\n', end - s);
+        s = (line_end) ? line_end + 1 : end;
+    }
+
+    trace_index_header_t h;
+    memset(&h, 0, sizeof(trace_index_header_t));
+    memcpy(h.magic, TRACE_INDEX_MAGIC, sizeof(h.magic));
+    h.version = TRACE_INDEX_VERSION;
+    h.stride = t->line_stride;
+    h.source_size = st->st_size;
+    h.source_mtime_ns = (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+    h.record_n = t->record_n;
+    h.offsets_n = (h.record_n + h.stride - 1) / h.stride;
+
+    // the index is only a cache ; if it cannot be written, it is rebuilt next time
+    FILE* f = fopen(idx_path, "w");
+    if(!f) {
+        printf("%s: could not write line index %s\n", t->filename, idx_path);
+        return;
+    }
+    int ok = fwrite(&h, sizeof(trace_index_header_t), 1, f) == 1 &&
+             fwrite(t->line_index, sizeof(uint64_t), h.offsets_n, f) == h.offsets_n;
+    if(fclose(f) != 0 || !ok) {
+        printf("%s: could not write line index %s\n", t->filename, idx_path);
+        remove(idx_path);
+    }
+}
+
+// maps the trace into memory once ; every process launched from this tracefile reads from the same mapping
+// picks the trace format from the file header and records where the accesses start
+void open_tracefile(tracefile_t* t) {
+
+    int fd = open(t->file_path, O_RDONLY);
+    if(fd < 0) {
+        printf("Failed to open file %s\n", t->file_path);
+        exit(1);
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) error("Failed to stat trace file");
+    t->size = st.st_size;
+    if(t->size == 0) {
+        printf("%s is empty\n", t->file_path);
+        exit(1);
+    }
+
+    t->map = mmap(NULL, t->size, PROT_READ, MAP_SHARED, fd, 0);
+    if(t->map == MAP_FAILED) error("Failed to map trace file");
+    close(fd); // the mapping stays valid
+
+    trace_header_t header;
+    if(read_trace_header(t->map, t->size, &header)) {
+        t->format = header.format;
+        t->record_n = header.record_n;
+        t->data_offset = header.header_size;
+        if(t->record_n == 0) {
+            printf("%s has no records\n", t->file_path);
+            exit(1);
+        }
+        if(t->format == TRACE_FMT_COMPRESSED) {
+            t->index_offset = header.index_offset;
+            t->blocks_n = (t->record_n + header.block_records_n - 1) / header.block_records_n;
+            t->size = t->index_offset; // blocks end where the index begins
+        } else {
+            t->size = t->data_offset + t->record_n * sizeof(trace_record_t); // ignore any trailing bytes
+        }
+        printf("%s: %s trace, %lu records (%s)\n", t->filename, (t->format == TRACE_FMT_COMPRESSED) ? "compressed" : "binary", t->record_n, header.source);
+    } else {
+        t->format = TRACE_FMT_TEXT;
+        t->data_offset = 0;
+
+        char* idx_path = malloc(strlen(t->file_path) + 5);
+        sprintf(idx_path, "%s.idx", t->file_path);
+        if(!load_line_index(t, idx_path, &st)) {
+            printf("%s: building line index %s\n", t->filename, idx_path);
+            build_line_index(t, idx_path, &st);
+        }
+        free(idx_path);
+        printf("%s: text trace, %lu records\n", t->filename, t->record_n);
+    }
+}
+
+// finds the beginning of a random memory trace in the file ; text and binary traces start at any record with equal chance
+long int get_rand_trace_offset(sim_t* sim, tracefile_t* t) {
+
+    if(t->format == TRACE_FMT_BINARY) { // records are fixed size
+        return t->data_offset + rand_below(sim, t->record_n) * sizeof(trace_record_t);
+    } else if(t->format == TRACE_FMT_COMPRESSED) { // decoding can only start at a block
+        uint64_t offset;
+        memcpy(&offset, t->map + t->index_offset + rand_below(sim, t->blocks_n) * sizeof(uint64_t), sizeof(uint64_t));
+        return offset;
+    }
+
+    // text ; jump to the closest indexed line before the record, then skip lines
+    uint64_t record = rand_below(sim, t->record_n);
+    const char* s = t->map + t->line_index[record / t->line_stride];
+    const char* end = t->map + t->size;
+    for(uint64_t i=0; i<record % t->line_stride; i++) {
+        s = (const char*) memchr(s, '\n', end - s) + 1; // the index guarantees the line exists
+    }
+    return s - t->map;
+}
+
+// places the process's cursor at its starting offset ; compressed traces must start at a block
+void seek_trace(process_t* p, long int offset) {
+    p->cursor = p->tracefile->map + offset;
+    p->stream.block_left = 0;
+}
+
+// decodes the next access of a compressed trace ; returns the file offset it was read from
+static long int read_compressed_access(process_t* p, access_t* a) {
+
+    tracefile_t* t = p->tracefile;
+    trace_stream_t* s = &p->stream;
+    long int pos = p->cursor - t->map;
+
+    if(s->block_left == 0) { // start of a block
+        trace_block_t block;
+        memcpy(&block, p->cursor, sizeof(trace_block_t));
+        p->cursor += sizeof(trace_block_t);
+        s->block_left = block.record_n;
+        s->run_left = 0;
+        memset(s->prev_addr, 0, sizeof(s->prev_addr));
+    }
+
+    const uint8_t* buf = (const uint8_t*) p->cursor;
+    if(s->run_left == 0) {
+        uint64_t run = varint_decode(&buf);
+        s->run_left = run >> 1;
+        s->enclave_mode = run & 1;
+        s->interval = varint_decode(&buf) / TRACE_INTERVAL_SCALE;
+    }
+    uint64_t v = varint_decode(&buf);
+    int op = v & 3;
+    uint64_t addr = s->prev_addr[op] + (uint64_t) zigzag_decode(v >> 2);
+    s->prev_addr[op] = addr;
+    p->cursor = (char*) buf;
+
+    s->run_left--;
+    s->block_left--;
+
+    a->interval = s->interval;
+    a->enclave_mode = s->enclave_mode;
+    a->addr = addr;
+    a->op = op;
+    return pos;
+}
+
+// parses "<interval> <enclave_mode> <addr> <op>" in the format written by the pintool ; returns 0 if the line looks different
+static int parse_line(const char* s, const char* end, access_t* a) {
+
+    // interval ; digits with an optional fraction, parsed exactly as strtod() would when it fits in 15 digits
+    uint64_t mantissa = 0;
+    int digits_n = 0;
+    int frac_n = 0;
+    char frac = 0;
+    while(s < end) {
+        if(*s >= '0' && *s <= '9') {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits_n++;
+            if(frac) frac_n++;
+        } else if(*s == '.' && !frac) frac = 1;
+        else break;
+        s++;
+    }
+    if(digits_n == 0 || digits_n > 15 || s == end || *s != ' ') return 0;
+    s++;
+
+    // enclave mode
+    if(s + 1 >= end || s[0] < '0' || s[0] > '9' || s[1] != ' ') return 0;
+    int enclave_mode = s[0] - '0';
+    s += 2;
+
+    // address ; hexadecimal with a 0x prefix
+    if(s + 2 >= end || s[0] != '0' || s[1] != 'x') return 0;
+    s += 2;
+    uint64_t addr = 0;
+    int hex_n = 0;
+    while(s < end && *s != ' ') {
+        char c = *s;
+        int v;
+        if(c >= '0' && c <= '9') v = c - '0';
+        else if(c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return 0;
+        addr = (addr << 4) | v;
+        hex_n++;
+        s++;
+    }
+    if(hex_n == 0 || hex_n > 16 || s == end) return 0;
+    s++;
+
+    // op
+    if(s >= end || s[0] < '0' || s[0] > '9') return 0;
+    int op = s[0] - '0';
+    s++;
+    if(s != end && *s != '\n') return 0;
+
+    a->interval = (double) mantissa / pow10_table[frac_n];
+    a->enclave_mode = enclave_mode;
+    a->addr = addr;
+    a->op = op;
+    return 1;
+}
+
+// reads the next access of this process into a ; loops around to the first access at the end of the file
+// returns the file offset the access was read from
+long int read_access(process_t* p, access_t* a) {
+
+    tracefile_t* t = p->tracefile;
+    char* end = t->map + t->size;
+    if(p->cursor >= end) p->cursor = t->map + t->data_offset; // loop around to the beginning
+    long int pos = p->cursor - t->map;
+
+    if(t->format == TRACE_FMT_COMPRESSED) {
+        pos = read_compressed_access(p, a);
+    } else if(t->format == TRACE_FMT_BINARY) {
+        const trace_record_t* r = (const trace_record_t*) p->cursor;
+        a->interval = r->interval / TRACE_INTERVAL_SCALE;
+        a->enclave_mode = r->enclave_mode;
+        a->addr = r->addr;
+        a->op = r->op;
+        p->cursor += sizeof(trace_record_t);
+    } else {
+        char* line_end = memchr(p->cursor, '\n', end - p->cursor);
+        if(!line_end) line_end = end;
+
+        if(!parse_line(p->cursor, line_end, a)) {
+            // anything unusual (ex. the "<n>#eof" line) is handled by sscanf, like a line read with getline()
+            char line[256];
+            size_t len = line_end - p->cursor;
+            if(len >= sizeof(line)) len = sizeof(line) - 1;
+            memcpy(line, p->cursor, len);
+            line[len] = '\0';
+            sscanf(line, "%lf %i %p %i\n", &a->interval, &a->enclave_mode, (void**) &a->addr, &a->op);
+        }
+        p->cursor = (line_end < end) ? line_end + 1 : end;
+    }
+
+    return pos;
+}
+
+// returns 1 if every ring of this decoder has no room for another batch
+static char decoder_rings_full(decoder_t* d) {
+    sim_t* sim = d->sim;
+    for(int i=d->id; i<sim->cores_n; i+=sim->decoders_n) {
+        access_ring_t* ring = sim->cores[i].ring;
+        if(!ring) continue;
+        if(atomic_load(&ring->head) - atomic_load(&ring->tail) < DECODE_BATCHES_N) return 0;
+    }
+    return 1;
+}
+
+static void* decode_loop(void* arg) {
+
+    decoder_t* d = (decoder_t*) arg;
+    sim_t* sim = d->sim;
+
+    while(atomic_load(&d->running)) {
+        char decoded = 0;
+        for(int i=d->id; i<sim->cores_n; i+=sim->decoders_n) {
+            access_ring_t* ring = sim->cores[i].ring;
+            if(!ring) continue;
+
+            uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            if(head - atomic_load_explicit(&ring->tail, memory_order_acquire) == DECODE_BATCHES_N) continue; // full
+
+            access_batch_t* b = &ring->batches[head % DECODE_BATCHES_N];
+            for(int j=0; j<DECODE_BATCH_N; j++) {
+                b->pos[j] = read_access(ring->p, &b->accesses[j]);
+            }
+            atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+            decoded = 1;
+
+            pthread_mutex_lock(&d->lock);
+            pthread_cond_broadcast(&d->filled);
+            pthread_mutex_unlock(&d->lock);
+        }
+
+        if(!decoded) { // wait until the simulation thread consumes a batch
+            pthread_mutex_lock(&d->lock);
+            while(atomic_load(&d->running) && decoder_rings_full(d)) pthread_cond_wait(&d->drained, &d->lock);
+            pthread_mutex_unlock(&d->lock);
+        }
+    }
+
+    return NULL;
+}
+
+// decodes traces ahead of the simulation thread ; each core gets a ring of decoded accesses
+void start_decoders(sim_t* sim) {
+
+    if(sim->decoders_n <= 0) return; // accesses are decoded by the simulation thread
+    if(sim->decoders_n > sim->cores_n) sim->decoders_n = sim->cores_n;
+
+    sim->decoders = (decoder_t*) malloc(sim->decoders_n * sizeof(decoder_t));
+    for(int i=0; i<sim->decoders_n; i++) {
+        decoder_t* d = &sim->decoders[i];
+        d->id = i;
+        d->sim = sim;
+        atomic_init(&d->running, 1);
+        pthread_mutex_init(&d->lock, NULL);
+        pthread_cond_init(&d->filled, NULL);
+        pthread_cond_init(&d->drained, NULL);
+    }
+
+    for(int i=0; i<sim->cores_n; i++) {
+        core_t* core = &sim->cores[i];
+        if(core->current_process < 0) continue;
+
+        access_ring_t* ring = (access_ring_t*) malloc(sizeof(access_ring_t));
+        ring->batches = (access_batch_t*) malloc(DECODE_BATCHES_N * sizeof(access_batch_t));
+        memset(ring->batches, 0, DECODE_BATCHES_N * sizeof(access_batch_t));
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        ring->next = 0;
+        ring->p = &core->processes[core->current_process];
+        ring->decoder = &sim->decoders[i % sim->decoders_n];
+        core->ring = ring;
+    }
+
+    for(int i=0; i<sim->decoders_n; i++) {
+        if(pthread_create(&sim->decoders[i].thread, NULL, decode_loop, &sim->decoders[i]) != 0) error("Failed to start decoder thread");
+    }
+    printf("Decoding traces on %i threads\n", sim->decoders_n);
+}
+
+void stop_decoders(sim_t* sim) {
+
+    for(int i=0; i<sim->decoders_n; i++) {
+        decoder_t* d = &sim->decoders[i];
+        pthread_mutex_lock(&d->lock);
+        atomic_store(&d->running, 0);
+        pthread_cond_broadcast(&d->drained);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+    }
+}
+
+// next access of the process running on this core, from the core's ring if traces are decoded in the background
+// returns the file offset the access was read from
+long int fetch_access(core_t* core, process_t* p, access_t* a) {
+
+    access_ring_t* ring = core->ring;
+    if(!ring) return read_access(p, a);
+    assert(ring->p == p);
+
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if(atomic_load_explicit(&ring->head, memory_order_acquire) == tail) { // decoder has not caught up
+        decoder_t* d = ring->decoder;
+        pthread_mutex_lock(&d->lock);
+        while(atomic_load_explicit(&ring->head, memory_order_acquire) == tail) pthread_cond_wait(&d->filled, &d->lock);
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    access_batch_t* b = &ring->batches[tail % DECODE_BATCHES_N];
+    access_t* decoded = &b->accesses[ring->next];
+    a->interval = decoded->interval;
+    a->enclave_mode = decoded->enclave_mode;
+    a->addr = decoded->addr;
+    a->op = decoded->op;
+    long int pos = b->pos[ring->next];
+
+    ring->next++;
+    if(ring->next == DECODE_BATCH_N) { // hand the batch back to the decoder
+        ring->next = 0;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        decoder_t* d = ring->decoder;
+        pthread_mutex_lock(&d->lock);
+        pthread_cond_signal(&d->drained);
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    return pos;
+}
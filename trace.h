@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "sim.h"
+#include "trace_format.h"
+
+/*
+    Line index of a text trace ; cached next to the trace as <trace>.idx and rebuilt when the trace changes.
+    Holds the file offset of every TRACE_INDEX_STRIDE-th line, so any line can be found by skipping at most
+    TRACE_INDEX_STRIDE - 1 lines.
+*/
+#define TRACE_INDEX_MAGIC "SGXCIDX"
+#define TRACE_INDEX_VERSION 1
+#define TRACE_INDEX_STRIDE 1024
+
+typedef struct trace_index_header_t {
+    char magic[8]; // TRACE_INDEX_MAGIC
+    uint32_t version; // TRACE_INDEX_VERSION
+    uint32_t stride; // lines between two offsets
+    uint64_t source_size; // size and modification time of the trace when the index was built
+    int64_t source_mtime_ns;
+    uint64_t record_n; // lines in the trace
+    uint64_t offsets_n; // uint64_t offsets that follow
+} trace_index_header_t;
+
+#define DECODE_BATCH_N 2048 // accesses decoded at a time by a decoder thread
+#define DECODE_BATCHES_N 4 // batches buffered per core ; the simulation thread consumes one while the next ones are decoded
+
+typedef struct access_batch_t {
+    access_t accesses[DECODE_BATCH_N];
+    long int pos[DECODE_BATCH_N]; // file offset each access was read from
+} access_batch_t;
+
+// decoded accesses of one core ; single producer (decoder thread), single consumer (simulation thread)
+typedef struct access_ring_t {
+    access_batch_t* batches; // DECODE_BATCHES_N batches
+    _Atomic uint64_t head; // number of batches filled by the decoder
+    _Atomic uint64_t tail; // number of batches consumed by the simulation thread
+    int next; // next access to consume in the batch at tail
+
+    process_t* p; // process whose trace is decoded
+    decoder_t* decoder;
+} access_ring_t;
+
+// a decoder thread fills the rings of cores decoder.id, decoder.id + decoders_n, ...
+typedef struct decoder_t {
+    int id;
+    sim_t* sim;
+    pthread_t thread;
+    atomic_int running;
+
+    pthread_mutex_t lock;
+    pthread_cond_t filled; // a batch was published
+    pthread_cond_t drained; // a batch was consumed
+} decoder_t;
+
+int read_trace_header(const char* map, size_t size, trace_header_t* header);
+void open_tracefile(tracefile_t* t);
+
+long int get_rand_trace_offset(sim_t* sim, tracefile_t* t);
+void seek_trace(process_t* p, long int offset);
+long int read_access(process_t* p, access_t* a);
+
+void start_decoders(sim_t* sim);
+void stop_decoders(sim_t* sim);
+long int fetch_access(core_t* core, process_t* p, access_t* a);
+
+#endif /* TRACE_H */
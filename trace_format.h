@@ -0,0 +1,96 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+/*
+    On-disk layout of binary trace files.
+
+    A binary trace starts with a trace_header_t followed by header.record_n trace_record_t.
+    A compressed trace starts with a trace_header_t followed by blocks of up to header.block_records_n accesses
+    and an index holding the file offset (uint64_t) of every block. Each block is a trace_block_t followed by
+    runs of accesses that share an interval and enclave mode:
+        run:    varint (run length << 1 | enclave_mode), varint interval, then run length accesses
+        access: varint (zigzag(addr - previous addr of the same op) << 2 | op)
+    Previous addresses start at 0 in every block, so decoding can start at any block.
+    Text traces (one "interval enclave_mode addr op" line per access) have no header ;
+    readers tell them apart from the other formats by checking for TRACE_MAGIC at the start of the file.
+
+    This header has no dependencies on the simulator so that the pintool and sgxc-convert can include it.
+*/
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "SGXCTRC" // 7 chars + null terminator fills trace_header_t.magic
+#define TRACE_VERSION 2 // 2: compressed traces (index_offset, block_records_n)
+
+/* trace formats */
+#define TRACE_FMT_TEXT 0
+#define TRACE_FMT_BINARY 1
+#define TRACE_FMT_COMPRESSED 2
+
+#define TRACE_BLOCK_RECORDS_N 4096 // accesses per block of a compressed trace
+
+// intervals are stored as integers in millionths, which is the precision of the "%f" text traces
+#define TRACE_INTERVAL_SCALE 1000000.0
+
+typedef struct trace_header_t {
+    char magic[8]; // TRACE_MAGIC
+    uint32_t version; // TRACE_VERSION
+    uint32_t format; // TRACE_FMT_*
+    uint32_t header_size; // byte offset of the first record
+    uint32_t record_size; // sizeof(trace_record_t) when the trace was written
+    uint64_t record_n; // number of records in the file
+    char source[256]; // where the records came from (ex. original text trace, traced program)
+    uint64_t index_offset; // TRACE_FMT_COMPRESSED: file offset of the block index
+    uint32_t block_records_n; // TRACE_FMT_COMPRESSED: accesses per block (the last block may have fewer)
+    uint32_t reserved;
+} trace_header_t;
+
+// start of a block in a compressed trace
+typedef struct trace_block_t {
+    uint32_t record_n; // accesses in this block
+    uint32_t size; // bytes of encoded accesses that follow
+} trace_block_t;
+
+// one memory reference ; 16 bytes
+typedef struct trace_record_t {
+    uint64_t addr;
+    uint32_t interval; // in 1/TRACE_INTERVAL_SCALE units
+    uint16_t tid; // thread that made the reference ; 0 for single-threaded traces
+    uint8_t op; // LOAD_OP, STORE_OP, INSN_OP
+    uint8_t enclave_mode;
+} trace_record_t;
+
+// signed address deltas are zigzag encoded so that small negative deltas stay small
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+// writes v in 7-bit groups, least significant first ; returns the number of bytes written (at most 10)
+static inline int varint_encode(uint8_t* buf, uint64_t v) {
+    int n = 0;
+    while(v >= 0x80) {
+        buf[n++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (uint8_t) v;
+    return n;
+}
+
+static inline uint64_t varint_decode(const uint8_t** buf) {
+    const uint8_t* p = *buf;
+    uint64_t v = 0;
+    int shift = 0;
+    while(*p & 0x80) {
+        v |= (uint64_t) (*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= (uint64_t) (*p++) << shift;
+    *buf = p;
+    return v;
+}
+
+#endif /* TRACE_FORMAT_H */
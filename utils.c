@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <string.h>
+#include <time.h>
 
 #include "utils.h"
 
@@ -7,33 +9,44 @@ void error(char* msg) {
 	exit(1);	
 }
 
-void swap(access_t* a, access_t* b) {
-	access_t t = *a;
-	*a = *b;
-	*b = t;
+// seconds since an arbitrary point ; elapsed time of the simulation, which may run on several threads
+double wall_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int partition(access_t* queue, int l, int h) {
-	double pivot = queue[h].timestamp;
-	int i = l-1;
-
-	for(int j=l; j<=h-1; j++) {
-		if(queue[j].timestamp <= pivot) {
-			i++;
-			swap(&queue[i], &queue[j]);
-		}
-	}
+// 1 if core a's pending access comes before core b's ; ties go to the lower core id
+static inline int earlier(access_t* queue, int a, int b) {
+    if(queue[a].timestamp != queue[b].timestamp) return queue[a].timestamp < queue[b].timestamp;
+    return a < b;
+}
 
-	swap(&queue[i+1], &queue[h]);
-	return (i+1);
+// adds a core to the min-heap of cores ordered by the timestamp of their pending access (queue[core_id])
+void heap_push(int* heap, int* heap_n, access_t* queue, int core_id) {
+    int i = (*heap_n)++;
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if(!earlier(queue, core_id, heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = core_id;
 }
 
-void quicksort(access_t* queue, int l, int h) {
-	if(l < h) {
-		int p = partition(queue, l, h); // p = partitioning index
-		quicksort(queue, l, p-1);
-		quicksort(queue, p+1, h);
-	}
+// restores heap order after the pending access of the core at the top (heap[0]) was replaced
+void heap_sift_down(int* heap, int heap_n, access_t* queue) {
+    int core_id = heap[0];
+    int i = 0;
+    while(1) {
+        int child = 2 * i + 1;
+        if(child >= heap_n) break;
+        if(child + 1 < heap_n && earlier(queue, heap[child + 1], heap[child])) child++;
+        if(!earlier(queue, heap[child], core_id)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = core_id;
 }
 
 // https://stackoverflow.com/questions/1322510/given-an-integer-how-do-i-find-the-next-largest-power-of-two-using-bit-twiddlin
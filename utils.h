@@ -8,9 +8,10 @@
 
 void error(char* msg);
 
-void swap(access_t* a, access_t* b);
-int partition(access_t* queue, int l, int h);
-void quicksort(access_t* queue, int l, int h);
+double wall_time();
+
+void heap_push(int* heap, int* heap_n, access_t* queue, int core_id);
+void heap_sift_down(int* heap, int heap_n, access_t* queue);
 
 int next_pow2(int n);
 void remove_substring(char* str, char* sub);